@@ -0,0 +1,358 @@
+// This file's header
+#include "display_sim.h"
+
+// C++ standard headers
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <vector>
+
+// ESP-IDF headers
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+
+// Component headers
+#include "board_defs.h"
+#include "display_controllers.h"
+#include "pixel_types.h"
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// GPIO
+
+static int s_gpio_level[GPIO_NUM_MAX];
+
+esp_err_t gpio_config(const gpio_config_t *config)
+{
+    if (config->pin_bit_mask >> GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t pin)
+{
+    if (pin < 0 || pin >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio_level[pin] = 0;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_direction(gpio_num_t pin, gpio_mode_t)
+{
+    return pin < 0 || pin >= GPIO_NUM_MAX ? ESP_ERR_INVALID_ARG : ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    if (pin < 0 || pin >= GPIO_NUM_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_gpio_level[pin] = level != 0;
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin)
+{
+    assert(0 <= pin && pin < GPIO_NUM_MAX);
+    return s_gpio_level[pin];
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Panel
+
+// The display controller's side of the bus.
+struct SimPanel {
+
+    SimPanel()
+    : m_frame(DISPLAY_WIDTH * DISPLAY_HEIGHT),
+      m_command(0),
+      m_param_count(0),
+      m_params{},
+      m_x0(0), m_x1(0), m_y0(0), m_y1(0),
+      m_x(0), m_y(0),
+      m_pixel_bytes(0),
+      m_pixel_high(0),
+      m_stats{},
+      m_frame_number(0),
+      m_dump_format(nullptr)
+    {}
+
+    void receive(const uint8_t *bytes, size_t count, bool is_data)
+    {
+        for (size_t i = 0; i < count; i++) {
+            if (!is_data) {
+                command(bytes[i]);
+            } else if (m_command == RAMWR) {
+                pixel_byte(bytes[i]);
+            } else {
+                param(bytes[i]);
+            }
+        }
+    }
+
+    std::vector<uint16_t> m_frame;
+    uint8_t m_command;
+    size_t m_param_count;
+    uint8_t m_params[4];
+    int m_x0, m_x1, m_y0, m_y1;
+    int m_x, m_y;
+    size_t m_pixel_bytes;
+    uint8_t m_pixel_high;
+    DisplaySimStats m_stats;
+    unsigned m_frame_number;
+    const char *m_dump_format;
+
+private:
+    void command(uint8_t cmd)
+    {
+        m_command = cmd;
+        m_param_count = 0;
+        m_stats.command_bytes++;
+        if (cmd == RAMWR) {
+            m_x = m_x0;
+            m_y = m_y0;
+            m_pixel_bytes = 0;
+            m_stats.windows++;
+        }
+    }
+
+    void param(uint8_t byte)
+    {
+        m_stats.command_bytes++;
+        if (m_param_count < sizeof m_params) {
+            m_params[m_param_count] = byte;
+        }
+        if (++m_param_count != sizeof m_params) {
+            return;
+        }
+        int lo = m_params[0] << 8 | m_params[1];
+        int hi = m_params[2] << 8 | m_params[3];
+        if (m_command == CASET) {
+            m_x0 = lo;
+            m_x1 = hi;
+        } else if (m_command == PASET) {
+            m_y0 = lo;
+            m_y1 = hi;
+        }
+    }
+
+    void pixel_byte(uint8_t byte)
+    {
+        m_stats.pixel_bytes++;
+        if (m_pixel_bytes++ % 2 == 0) {
+            m_pixel_high = byte;
+            return;
+        }
+
+        // Controller coordinates to display coordinates.
+        const DisplayController& ctlr = DISPLAY_CTLR;
+        int x = m_x - ctlr.CASET_x0_adjust;
+        int y = m_y - ctlr.RASET_y0_adjust;
+        if (0 <= x && x < DISPLAY_WIDTH && 0 <= y && y < DISPLAY_HEIGHT) {
+            m_frame[y * DISPLAY_WIDTH + x] = m_pixel_high << 8 | byte;
+        } else {
+            m_stats.offscreen_pixels++;
+        }
+
+        // The controller wraps at the window's edges.
+        if (++m_x > m_x1) {
+            m_x = m_x0;
+            if (++m_y > m_y1) {
+                m_y = m_y0;
+                m_stats.window_wraps++;
+            }
+        }
+    }
+};
+
+static SimPanel s_panel;
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// SPI Bus
+
+struct spi_device_t {
+    spi_device_interface_config_t config;
+    std::deque<spi_transaction_t *> results;
+};
+
+static size_t s_max_transfer_bytes;
+static spi_device_t *s_device;
+
+esp_err_t spi_bus_initialize(spi_host_device_t,
+                             const spi_bus_config_t *config,
+                             int)
+{
+    s_max_transfer_bytes = config->max_transfer_sz
+                         ? config->max_transfer_sz
+                         : SPI_MAX_DMA_LEN;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t)
+{
+    return s_device ? ESP_ERR_INVALID_STATE : ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t,
+                             const spi_device_interface_config_t *config,
+                             spi_device_handle_t *handle)
+{
+    if (s_device) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    s_device = new spi_device_t{*config, {}};
+    *handle = s_device;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle)
+{
+    // Uncollected results are fine; every transaction is done.
+    if (handle != s_device) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    delete s_device;
+    s_device = nullptr;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_get_max_transaction_len(spi_host_device_t, size_t *len)
+{
+    *len = s_max_transfer_bytes;
+    return ESP_OK;
+}
+
+// Send one transaction over the bus and finish it.
+static void transfer(spi_device_handle_t dev, spi_transaction_t *trans)
+{
+    if (dev->config.pre_cb) {
+        (*dev->config.pre_cb)(trans);
+    }
+    assert(trans->length % 8 == 0);
+    size_t count = trans->length / 8;
+    const uint8_t *bytes = (trans->flags & SPI_TRANS_USE_TXDATA)
+                         ? trans->tx_data
+                         : (const uint8_t *)trans->tx_buffer;
+    bool is_data = gpio_get_level(DISPLAY_DC_GPIO);
+    s_panel.receive(bytes, count, is_data);
+    s_panel.m_stats.transactions++;
+    s_panel.m_stats.bus_usec +=
+        trans->length * 1e6 / dev->config.clock_speed_hz;
+    if (dev->config.post_cb) {
+        (*dev->config.post_cb)(trans);
+    }
+}
+
+static esp_err_t check_length(const spi_transaction_t *trans)
+{
+    size_t max_bits = (trans->flags & SPI_TRANS_USE_TXDATA)
+                    ? 32
+                    : s_max_transfer_bytes * 8;
+    return trans->length <= max_bits ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+// The driver holds queue_size transactions until their results are
+// collected.  There's nothing to wait for here, so a full queue
+// would block forever.
+esp_err_t spi_device_queue_trans(spi_device_handle_t dev,
+                                 spi_transaction_t *trans,
+                                 TickType_t)
+{
+    if (esp_err_t err = check_length(trans)) {
+        return err;
+    }
+    if (dev->results.size() >= (size_t)dev->config.queue_size) {
+        return ESP_ERR_TIMEOUT;
+    }
+    transfer(dev, trans);
+    dev->results.push_back(trans);
+    return ESP_OK;
+}
+
+esp_err_t spi_device_get_trans_result(spi_device_handle_t dev,
+                                      spi_transaction_t **trans,
+                                      TickType_t)
+{
+    if (dev->results.empty()) {
+        return ESP_ERR_TIMEOUT;
+    }
+    *trans = dev->results.front();
+    dev->results.pop_front();
+    return ESP_OK;
+}
+
+esp_err_t spi_device_transmit(spi_device_handle_t dev,
+                              spi_transaction_t *trans)
+{
+    if (!dev->results.empty()) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (esp_err_t err = check_length(trans)) {
+        return err;
+    }
+    transfer(dev, trans);
+    return ESP_OK;
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Simulator Interface
+
+const DisplaySimStats& display_sim_stats()
+{
+    return s_panel.m_stats;
+}
+
+DisplaySimStats display_sim_end_frame()
+{
+    DisplaySimStats stats = s_panel.m_stats;
+    s_panel.m_stats = {};
+    unsigned frame = s_panel.m_frame_number++;
+    if (s_panel.m_dump_format) {
+        char path[256];
+        snprintf(path, sizeof path, s_panel.m_dump_format, frame);
+        if (!display_sim_write_ppm(path)) {
+            fprintf(stderr, "display_sim: can't write %s\n", path);
+        }
+    }
+    return stats;
+}
+
+void display_sim_dump_frames(const char *path_format)
+{
+    s_panel.m_dump_format = path_format;
+}
+
+bool display_sim_write_ppm(const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        return false;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", DISPLAY_WIDTH, DISPLAY_HEIGHT);
+    for (uint16_t value : s_panel.m_frame) {
+        pixel_type p;
+        p.b[0] = value >> 8;
+        p.b[1] = value;
+        uint8_t rgb[3] = { p.red8(), p.green8(), p.blue8() };
+        fwrite(rgb, 1, sizeof rgb, f);
+    }
+    return fclose(f) == 0;
+}
+
+uint16_t display_sim_pixel(size_t x, size_t y)
+{
+    assert(x < DISPLAY_WIDTH && y < DISPLAY_HEIGHT);
+    return s_panel.m_frame[y * DISPLAY_WIDTH + x];
+}
+
+void display_sim_fill(uint16_t value)
+{
+    std::fill(s_panel.m_frame.begin(), s_panel.m_frame.end(), value);
+}
@@ -0,0 +1,333 @@
+// Host build: the ESP-IDF calls the firmware makes outside the
+// display, FreeRTOS and partitions.
+
+// C++ standard headers
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+
+// ESP-IDF headers
+#include "driver/ledc.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "esp_adc/adc_oneshot.h"
+#include "esp_async_memcpy.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Time
+
+static const auto s_boot_time = std::chrono::steady_clock::now();
+
+static int64_t nsec_since_boot()
+{
+    auto t = std::chrono::steady_clock::now() - s_boot_time;
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+}
+
+int64_t esp_timer_get_time()
+{
+    return nsec_since_boot() / 1000;
+}
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count()
+{
+    return nsec_since_boot() * CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ / 1000;
+}
+
+struct HostEspTimer {
+    esp_timer_create_args_t args;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool armed = false;
+    bool deleted = false;
+    int64_t alarm_usec = 0;
+    uint64_t period_usec = 0;   // zero for one shot
+    std::thread thread;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!deleted) {
+            if (!armed) {
+                cv.wait(lock);
+                continue;
+            }
+            auto alarm = s_boot_time + std::chrono::microseconds(alarm_usec);
+            if (cv.wait_until(lock, alarm) != std::cv_status::timeout) {
+                continue;       // rearmed, stopped or deleted
+            }
+            if (period_usec) {
+                alarm_usec += period_usec;
+            } else {
+                armed = false;
+            }
+            lock.unlock();
+            args.callback(args.arg);
+            lock.lock();
+        }
+    }
+
+    esp_err_t start(uint64_t usec, uint64_t period)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (armed) {
+                return ESP_ERR_INVALID_STATE;
+            }
+            armed = true;
+            alarm_usec = esp_timer_get_time() + usec;
+            period_usec = period;
+        }
+        cv.notify_one();
+        return ESP_OK;
+    }
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args,
+                           esp_timer_handle_t *out_handle)
+{
+    if (!args || !args->callback || !out_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto *timer = new HostEspTimer;
+    timer->args = *args;
+    timer->thread = std::thread([timer] { timer->run(); });
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer->start(timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer,
+                                   uint64_t period_us)
+{
+    return timer->start(period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        if (!timer->armed) {
+            return ESP_ERR_INVALID_STATE;
+        }
+        timer->armed = false;
+    }
+    timer->cv.notify_one();
+    return ESP_OK;
+}
+
+// Unlike ESP-IDF's, this waits for a running callback to finish.
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        timer->deleted = true;
+    }
+    timer->cv.notify_one();
+    timer->thread.join();
+    delete timer;
+    return ESP_OK;
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Memory
+
+void *heap_caps_malloc(size_t size, uint32_t)
+{
+    return malloc(size);
+}
+
+void *heap_caps_aligned_alloc(size_t alignment, size_t size, uint32_t)
+{
+    // aligned_alloc wants a multiple of the alignment.
+    size = (size + alignment - 1) & ~(alignment - 1);
+    return aligned_alloc(alignment, size);
+}
+
+void heap_caps_free(void *p)
+{
+    free(p);
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t caps)
+{
+    // As much as the board has.
+    return caps & MALLOC_CAP_SPIRAM ? 8 * 1024 * 1024 : 300 * 1024;
+}
+
+esp_err_t esp_async_memcpy_install(const async_memcpy_config_t *,
+                                   async_memcpy_handle_t *mcp)
+{
+    static int s_token;
+    *mcp = (async_memcpy_handle_t)&s_token;
+    return ESP_OK;
+}
+
+esp_err_t esp_async_memcpy_uninstall(async_memcpy_handle_t)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_async_memcpy(async_memcpy_handle_t mcp,
+                           void *dst,
+                           void *src,
+                           size_t n,
+                           async_memcpy_isr_cb_t callback,
+                           void *cb_args)
+{
+    memcpy(dst, src, n);
+    if (callback) {
+        async_memcpy_event_t event = {};
+        callback(mcp, &event, cb_args);
+    }
+    return ESP_OK;
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Random Numbers
+
+uint32_t esp_random()
+{
+    static std::random_device s_device;
+    return s_device();
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// LEDC
+
+static uint32_t s_ledc_duty[LEDC_CHANNEL_MAX];
+static uint32_t s_ledc_pending_duty[LEDC_CHANNEL_MAX];
+
+esp_err_t ledc_timer_config(const ledc_timer_config_t *config)
+{
+    return config->timer_num < LEDC_TIMER_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t ledc_timer_rst(ledc_mode_t, ledc_timer_t timer)
+{
+    return timer < LEDC_TIMER_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t ledc_channel_config(const ledc_channel_config_t *config)
+{
+    if (config->channel >= LEDC_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_ledc_duty[config->channel] = config->duty;
+    s_ledc_pending_duty[config->channel] = config->duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_stop(ledc_mode_t, ledc_channel_t channel, uint32_t)
+{
+    if (channel >= LEDC_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_ledc_duty[channel] = 0;
+    return ESP_OK;
+}
+
+esp_err_t ledc_set_duty(ledc_mode_t, ledc_channel_t channel, uint32_t duty)
+{
+    if (channel >= LEDC_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_ledc_pending_duty[channel] = duty;
+    return ESP_OK;
+}
+
+esp_err_t ledc_update_duty(ledc_mode_t, ledc_channel_t channel)
+{
+    if (channel >= LEDC_CHANNEL_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    s_ledc_duty[channel] = s_ledc_pending_duty[channel];
+    return ESP_OK;
+}
+
+uint32_t host_ledc_duty(ledc_channel_t channel)
+{
+    return channel < LEDC_CHANNEL_MAX ? s_ledc_duty[channel] : 0;
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// ADC
+
+// About 4.0 V at the battery through the 1.28 board's divider.
+static const int BATTERY_READING_MV = 1143;
+
+esp_err_t adc_oneshot_new_unit(const adc_oneshot_unit_init_cfg_t *,
+                               adc_oneshot_unit_handle_t *unit)
+{
+    static int s_token;
+    *unit = (adc_oneshot_unit_handle_t)&s_token;
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_del_unit(adc_oneshot_unit_handle_t)
+{
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_config_channel(adc_oneshot_unit_handle_t,
+                                     adc_channel_t,
+                                     const adc_oneshot_chan_cfg_t *)
+{
+    return ESP_OK;
+}
+
+esp_err_t adc_oneshot_read(adc_oneshot_unit_handle_t unit,
+                           adc_channel_t,
+                           int *out_raw)
+{
+    if (!unit) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *out_raw = BATTERY_READING_MV;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_check_scheme(adc_cali_scheme_ver_t *scheme_mask)
+{
+    *scheme_mask = ADC_CALI_SCHEME_VER_CURVE_FITTING;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_create_scheme_curve_fitting(
+    const adc_cali_curve_fitting_config_t *,
+    adc_cali_handle_t *handle)
+{
+    static int s_token;
+    *handle = (adc_cali_handle_t)&s_token;
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_delete_scheme_curve_fitting(adc_cali_handle_t)
+{
+    return ESP_OK;
+}
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t,
+                                  int raw,
+                                  int *voltage_mV)
+{
+    *voltage_mV = raw;
+    return ESP_OK;
+}
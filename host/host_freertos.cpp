@@ -0,0 +1,292 @@
+// Host build: FreeRTOS calls on std::thread primitives.
+
+// C++ standard headers
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// ESP-IDF headers
+#include "freertos/FreeRTOS.h"
+
+static std::chrono::microseconds ticks_to_usec(TickType_t ticks)
+{
+    return std::chrono::microseconds((uint64_t)ticks * 1'000'000 /
+                                     CONFIG_FREERTOS_HZ);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    std::this_thread::sleep_for(ticks_to_usec(ticks));
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Tasks
+
+// Thrown through a deleted task's stack so it unwinds and its
+// thread ends.
+struct HostTaskDeleted {};
+
+struct HostTask {
+    std::mutex mutex;
+    std::condition_variable cv;
+    uint32_t notify_count = 0;
+    bool deleted = false;
+    BaseType_t core = 0;
+    std::thread thread;
+};
+
+// Threads the shim didn't start get a HostTask the first time
+// they ask for their handle.
+static thread_local HostTask *s_current_task;
+
+// A task pinned to core 1 says it's on core 1.  Everything else is
+// on core 0.
+BaseType_t xPortGetCoreID()
+{
+    return s_current_task ? s_current_task->core : 0;
+}
+
+static BaseType_t create_task(TaskFunction_t function,
+                              void *parameters,
+                              TaskHandle_t *created_task,
+                              BaseType_t core)
+{
+    auto *task = new HostTask;
+    task->core = core;
+    std::unique_lock<std::mutex> lock(task->mutex);
+    task->thread = std::thread([=] {
+        { std::lock_guard<std::mutex> started(task->mutex); }
+        s_current_task = task;
+        try {
+            function(parameters);
+        } catch (const HostTaskDeleted&) {
+        }
+    });
+    if (created_task) {
+        *created_task = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function,
+                       const char *,
+                       uint32_t,
+                       void *parameters,
+                       UBaseType_t,
+                       TaskHandle_t *created_task)
+{
+    return create_task(function, parameters, created_task, 0);
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function,
+                                   const char *,
+                                   uint32_t,
+                                   void *parameters,
+                                   UBaseType_t,
+                                   TaskHandle_t *created_task,
+                                   BaseType_t core_id)
+{
+    return create_task(function, parameters, created_task, core_id);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    if (task == nullptr || task == s_current_task) {
+        throw HostTaskDeleted();
+    }
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->deleted = true;
+    }
+    task->cv.notify_one();
+    task->thread.join();
+    delete task;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+    if (!s_current_task) {
+        s_current_task = new HostTask;
+    }
+    return s_current_task;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit,
+                          TickType_t ticks_to_wait)
+{
+    HostTask *task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto ready = [&] { return task->notify_count || task->deleted; };
+    if (ticks_to_wait == portMAX_DELAY) {
+        task->cv.wait(lock, ready);
+    } else {
+        task->cv.wait_for(lock, ticks_to_usec(ticks_to_wait), ready);
+    }
+    if (task->deleted) {
+        throw HostTaskDeleted();
+    }
+    uint32_t count = task->notify_count;
+    if (count) {
+        task->notify_count = clear_count_on_exit ? 0 : count - 1;
+    }
+    return count;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    assert(task);
+    {
+        std::lock_guard<std::mutex> lock(task->mutex);
+        task->notify_count++;
+    }
+    task->cv.notify_one();
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t *woken)
+{
+    if (woken) {
+        *woken = pdFALSE;
+    }
+    xTaskNotifyGive(task);
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Software Timers
+
+struct HostTimer {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::chrono::microseconds period;
+    bool auto_reload;
+    void *id;
+    TimerCallbackFunction_t callback;
+    bool running = false;
+    std::thread thread;
+};
+
+TimerHandle_t xTimerCreate(const char *,
+                           TickType_t period,
+                           UBaseType_t auto_reload,
+                           void *timer_id,
+                           TimerCallbackFunction_t callback)
+{
+    auto *timer = new HostTimer;
+    timer->period = ticks_to_usec(period);
+    timer->auto_reload = auto_reload;
+    timer->id = timer_id;
+    timer->callback = callback;
+    return timer;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t)
+{
+    std::lock_guard<std::mutex> lock(timer->mutex);
+    if (timer->running) {
+        return pdPASS;
+    }
+    timer->running = true;
+    timer->thread = std::thread([timer] {
+        // Absolute deadlines, so callback time doesn't drift the
+        // period.
+        auto deadline = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(timer->mutex);
+        while (timer->running) {
+            deadline += timer->period;
+            auto stopped = [timer] { return !timer->running; };
+            if (timer->cv.wait_until(lock, deadline, stopped)) {
+                break;
+            }
+            lock.unlock();
+            timer->callback(timer);
+            lock.lock();
+            if (!timer->auto_reload) {
+                timer->running = false;
+            }
+        }
+    });
+    return pdPASS;
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t)
+{
+    {
+        std::lock_guard<std::mutex> lock(timer->mutex);
+        timer->running = false;
+    }
+    timer->cv.notify_one();
+    if (timer->thread.joinable()) {
+        timer->thread.join();
+    }
+    return pdPASS;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t ticks_to_wait)
+{
+    xTimerStop(timer, ticks_to_wait);
+    delete timer;
+    return pdPASS;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Semaphores
+
+struct HostSemaphore {
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool given = false;
+};
+
+SemaphoreHandle_t xSemaphoreCreateBinary()
+{
+    return new HostSemaphore;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    delete sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks_to_wait)
+{
+    std::unique_lock<std::mutex> lock(sem->mutex);
+    auto given = [&] { return sem->given; };
+    if (ticks_to_wait == portMAX_DELAY) {
+        sem->cv.wait(lock, given);
+    } else if (!sem->cv.wait_for(lock, ticks_to_usec(ticks_to_wait), given)) {
+        return pdFALSE;
+    }
+    sem->given = false;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    {
+        std::lock_guard<std::mutex> lock(sem->mutex);
+        if (sem->given) {
+            return pdFALSE;
+        }
+        sem->given = true;
+    }
+    sem->cv.notify_one();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t *woken)
+{
+    if (woken) {
+        *woken = pdFALSE;
+    }
+    return xSemaphoreGive(sem);
+}
@@ -0,0 +1,73 @@
+// Host build: run the firmware as a program.
+//
+//   soulcage-host [clip directory] [refreshes] [trace file]
+//
+// The clips are <label>.bin files in the directory, "." by default.
+// The app runs the loop benchmark for this many refreshes, 600 by
+// default, and exits.  Zero refreshes runs it forever on the refresh
+// clock.  Given a trace file, the trace ring is dumped there at the
+// end; tools/trace_to_json.py converts it.
+
+// This file's header
+#include "host_main.h"
+
+// C++ standard headers
+#include <cstdio>
+#include <cstdlib>
+
+// ESP-IDF headers
+#include "esp_partition.h"
+
+// Component headers
+#include "display_sim.h"
+#include "trace.h"
+
+static unsigned s_benchmark_refreshes = 600;
+
+unsigned host_benchmark_refreshes()
+{
+    return s_benchmark_refreshes;
+}
+
+extern "C" void app_main();
+
+int main(int argc, char *argv[])
+{
+    if (argc > 4) {
+        fprintf(stderr,
+                "use: %s [clip directory] [refreshes] [trace file]\n",
+                argv[0]);
+        return 2;
+    }
+    if (argc > 1) {
+        host_set_partition_dir(argv[1]);
+    }
+    if (argc > 2) {
+        s_benchmark_refreshes = strtoul(argv[2], nullptr, 0);
+    }
+    FILE *trace_file = nullptr;
+    if (argc > 3) {
+        trace_file = fopen(argv[3], "w");
+        if (trace_file == nullptr) {
+            perror(argv[3]);
+            return 1;
+        }
+    }
+
+    app_main();
+
+    if (trace_file) {
+        Trace::dump(trace_file);
+        fclose(trace_file);
+    }
+
+    const DisplaySimStats& stats = display_sim_stats();
+    unsigned n = s_benchmark_refreshes;
+    printf("Display: %zu transactions, %zu windows, %zu pixel bytes, "
+           "%.0f usec of bus time per refresh\n",
+           stats.transactions / n,
+           stats.windows / n,
+           stats.pixel_bytes / n,
+           stats.bus_usec / n);
+    return 0;
+}
@@ -0,0 +1,194 @@
+// Host build: partitions on files.  See esp_partition.h.
+
+// C++ standard headers
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// POSIX headers
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// ESP-IDF headers
+#include "esp_partition.h"
+
+static const esp_partition_subtype_t CLIP_SUBTYPE =
+    (esp_partition_subtype_t)0x40;
+
+static std::string s_dir = ".";
+
+struct HostPartition {
+    esp_partition_t part;
+    std::string path;
+};
+
+// Found once, and never freed, like the real partition table.
+static std::vector<HostPartition> *s_table;
+
+struct HostMapping {
+    const void *addr;
+    size_t size;
+};
+
+static std::vector<HostMapping> s_mappings;
+
+struct HostPartitionIterator {
+    size_t index;
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    std::string label;
+};
+
+void host_set_partition_dir(const char *path)
+{
+    s_dir = path;
+}
+
+static std::vector<HostPartition>& partition_table()
+{
+    if (s_table) {
+        return *s_table;
+    }
+    s_table = new std::vector<HostPartition>;
+
+    namespace fs = std::filesystem;
+    std::error_code err;
+    for (auto& entry : fs::directory_iterator(s_dir, err)) {
+        const fs::path& path = entry.path();
+        std::string label = path.stem().string();
+        if (path.extension() != ".bin" || label.size() > 16) {
+            continue;
+        }
+        uintmax_t size = entry.file_size(err);
+        if (err || size == 0 || size > UINT32_MAX) {
+            continue;
+        }
+        HostPartition hp = {};
+        hp.part.type = ESP_PARTITION_TYPE_DATA;
+        hp.part.subtype = CLIP_SUBTYPE;
+        hp.part.size = size;
+        strcpy(hp.part.label, label.c_str());
+        hp.path = path.string();
+        s_table->push_back(hp);
+    }
+    if (err) {
+        printf("host partitions: can't read \"%s\": %s\n",
+               s_dir.c_str(), err.message().c_str());
+    }
+    std::sort(s_table->begin(), s_table->end(),
+              [](const HostPartition& a, const HostPartition& b) {
+                  return strcmp(a.part.label, b.part.label) < 0;
+              });
+    uint32_t address = 0x10000;
+    for (auto& hp : *s_table) {
+        hp.part.address = address;
+        address += (hp.part.size + 0xFFFF) & ~0xFFFF;
+        printf("host partitions: %-16s %8" PRIu32 " bytes  %s\n",
+               hp.part.label, hp.part.size, hp.path.c_str());
+    }
+    return *s_table;
+}
+
+static bool matches(const HostPartitionIterator *it, const HostPartition& hp)
+{
+    if (it->type != ESP_PARTITION_TYPE_ANY && it->type != hp.part.type) {
+        return false;
+    }
+    if (it->subtype != ESP_PARTITION_SUBTYPE_ANY &&
+        it->subtype != hp.part.subtype) {
+        return false;
+    }
+    return it->label.empty() || it->label == hp.part.label;
+}
+
+// Move to the first match at or after it->index, or release it.
+static esp_partition_iterator_t advance(esp_partition_iterator_t it)
+{
+    auto& table = partition_table();
+    while (it->index < table.size() && !matches(it, table[it->index])) {
+        it->index++;
+    }
+    if (it->index == table.size()) {
+        delete it;
+        return nullptr;
+    }
+    return it;
+}
+
+esp_partition_iterator_t esp_partition_find(esp_partition_type_t type,
+                                            esp_partition_subtype_t subtype,
+                                            const char *label)
+{
+    auto *it = new HostPartitionIterator{0, type, subtype, label ? label : ""};
+    return advance(it);
+}
+
+esp_partition_iterator_t esp_partition_next(esp_partition_iterator_t it)
+{
+    it->index++;
+    return advance(it);
+}
+
+const esp_partition_t *esp_partition_get(esp_partition_iterator_t it)
+{
+    return it ? &partition_table()[it->index].part : nullptr;
+}
+
+void esp_partition_iterator_release(esp_partition_iterator_t it)
+{
+    delete it;
+}
+
+esp_err_t esp_partition_mmap(const esp_partition_t *part,
+                             size_t offset,
+                             size_t size,
+                             esp_partition_mmap_memory_t,
+                             const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle)
+{
+    if (offset + size > part->size) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    auto& table = partition_table();
+    auto hp = std::find_if(table.begin(), table.end(),
+                           [&](const HostPartition& hp) {
+                               return &hp.part == part;
+                           });
+    if (hp == table.end()) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // Map from the start of the file; mmap offsets must be page
+    // aligned.
+    int fd = open(hp->path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return ESP_FAIL;
+    }
+    size_t map_size = offset + size;
+    void *addr = mmap(nullptr, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_mappings.push_back({addr, map_size});
+    *out_ptr = (const uint8_t *)addr + offset;
+    *out_handle = s_mappings.size();    // zero is no mapping
+    return ESP_OK;
+}
+
+void esp_partition_munmap(esp_partition_mmap_handle_t handle)
+{
+    if (handle == 0 || handle > s_mappings.size()) {
+        return;
+    }
+    HostMapping& m = s_mappings[handle - 1];
+    if (m.addr) {
+        munmap(const_cast<void *>(m.addr), m.size);
+        m.addr = nullptr;
+    }
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+// Host build: the entropy source is always on.
+
+inline void bootloader_random_enable() {}
+inline void bootloader_random_disable() {}
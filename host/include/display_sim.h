@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Display Simulator - a panel on a simulated SPI bus, for host builds
+//
+// display_sim.cpp implements the ESP-IDF SPI master and GPIO calls
+// the display driver makes, so the real SPIDisplayDriver runs
+// unchanged.  The simulated controller reads DC as each transaction
+// goes out, interprets CASET, PASET and RAMWR, and writes pixels into
+// a frame buffer the size of the board's display.  Other commands
+// are counted and ignored.
+//
+// Transactions finish as soon as they're queued; pre_cb and post_cb
+// are called on the caller's thread.  Bus time is modeled, not
+// spent: each transaction costs its bits at the device's clock
+// speed.  Real transactions also cost some setup time each, which
+// isn't modeled, so compare the transaction counts too.
+//
+// The driver is held to ESP-IDF's rules: a full queue, a transmit
+// with results uncollected, or a transaction longer than the bus
+// allows fails the way ESP_ERROR_CHECK would see it.
+
+struct DisplaySimStats {
+    size_t transactions;
+    size_t command_bytes;       // command bytes and their parameters
+    size_t pixel_bytes;         // RAMWR data
+    size_t windows;             // RAMWR commands
+    size_t offscreen_pixels;    // written outside the display
+    size_t window_wraps;        // writes that ran past a window's end
+    double bus_usec;
+};
+
+// Totals since the last display_sim_end_frame().
+extern const DisplaySimStats& display_sim_stats();
+
+// Call after each refresh.  Returns that refresh's totals and starts
+// new ones, and writes the frame buffer if dumping is on.
+extern DisplaySimStats display_sim_end_frame();
+
+// Write each frame at display_sim_end_frame() to a PPM file.  path
+// is a printf format with one unsigned, the frame number, like
+// "frame%04u.ppm".  nullptr stops.
+extern void display_sim_dump_frames(const char *path_format);
+
+extern bool display_sim_write_ppm(const char *path);
+
+// A pixel as sent: first byte high.
+extern uint16_t display_sim_pixel(size_t x, size_t y);
+extern void display_sim_fill(uint16_t value);
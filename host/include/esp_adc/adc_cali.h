@@ -0,0 +1,17 @@
+#pragma once
+
+// Host build: calibration is the identity, raw counts are mV.
+
+#include "esp_err.h"
+
+typedef struct HostADCCali *adc_cali_handle_t;
+
+typedef enum {
+    ADC_CALI_SCHEME_VER_LINE_FITTING = 1 << 0,
+    ADC_CALI_SCHEME_VER_CURVE_FITTING = 1 << 1,
+} adc_cali_scheme_ver_t;
+
+esp_err_t adc_cali_check_scheme(adc_cali_scheme_ver_t *scheme_mask);
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t,
+                                  int raw,
+                                  int *voltage_mV);
@@ -0,0 +1,36 @@
+#pragma once
+
+// Host build: the "DMA" copy is a memcpy, and the callback runs
+// before esp_async_memcpy() returns.
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+typedef struct HostAsyncMemcpy *async_memcpy_handle_t;
+
+typedef struct {
+    void *data;
+} async_memcpy_event_t;
+
+typedef bool (*async_memcpy_isr_cb_t)(async_memcpy_handle_t,
+                                      async_memcpy_event_t *,
+                                      void *cb_args);
+
+typedef struct {
+    uint32_t backlog;
+    size_t sram_trans_align;
+    size_t psram_trans_align;
+    size_t dma_burst_size;
+    uint32_t flags;
+} async_memcpy_config_t;
+
+esp_err_t esp_async_memcpy_install(const async_memcpy_config_t *,
+                                   async_memcpy_handle_t *);
+esp_err_t esp_async_memcpy_uninstall(async_memcpy_handle_t);
+esp_err_t esp_async_memcpy(async_memcpy_handle_t,
+                           void *dst,
+                           void *src,
+                           size_t n,
+                           async_memcpy_isr_cb_t,
+                           void *cb_args);
@@ -0,0 +1,8 @@
+#pragma once
+
+// Host build: memory placement attributes mean nothing here.
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define DMA_ATTR
+#define EXT_RAM_BSS_ATTR
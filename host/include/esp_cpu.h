@@ -0,0 +1,10 @@
+#pragma once
+
+// Host build: a cycle counter that counts at CPU_FREQ_MHZ, so
+// cycle budgets written for the ESP32-S3 read the same here.
+
+#include <cstdint>
+
+typedef uint32_t esp_cpu_cycle_count_t;
+
+esp_cpu_cycle_count_t esp_cpu_get_cycle_count();
@@ -0,0 +1,55 @@
+#pragma once
+
+// Host build: partitions are files.  Each <label>.bin in the clip
+// directory is a data partition of subtype 0x40, the clip subtype,
+// in label order.  Mapping one maps the file read only.
+
+#include <cstddef>
+#include <cstdint>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_PARTITION_TYPE_APP = 0x00,
+    ESP_PARTITION_TYPE_DATA = 0x01,
+    ESP_PARTITION_TYPE_ANY = 0xff,
+} esp_partition_type_t;
+
+typedef enum {
+    ESP_PARTITION_SUBTYPE_ANY = 0xff,
+} esp_partition_subtype_t;
+
+typedef enum {
+    ESP_PARTITION_MMAP_DATA,
+    ESP_PARTITION_MMAP_INST,
+} esp_partition_mmap_memory_t;
+
+typedef uint32_t esp_partition_mmap_handle_t;
+
+typedef struct {
+    esp_partition_type_t type;
+    esp_partition_subtype_t subtype;
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+
+typedef struct HostPartitionIterator *esp_partition_iterator_t;
+
+esp_partition_iterator_t esp_partition_find(esp_partition_type_t,
+                                            esp_partition_subtype_t,
+                                            const char *label);
+esp_partition_iterator_t esp_partition_next(esp_partition_iterator_t);
+const esp_partition_t *esp_partition_get(esp_partition_iterator_t);
+void esp_partition_iterator_release(esp_partition_iterator_t);
+
+esp_err_t esp_partition_mmap(const esp_partition_t *,
+                             size_t offset,
+                             size_t size,
+                             esp_partition_mmap_memory_t,
+                             const void **out_ptr,
+                             esp_partition_mmap_handle_t *out_handle);
+void esp_partition_munmap(esp_partition_mmap_handle_t);
+
+// Host only.  Where the .bin files are.  The default is the
+// current directory.
+void host_set_partition_dir(const char *path);
@@ -0,0 +1,7 @@
+#pragma once
+
+// Host build: esp_random() comes from std::random_device.
+
+#include <cstdint>
+
+uint32_t esp_random();
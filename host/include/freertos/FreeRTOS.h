@@ -0,0 +1,33 @@
+#pragma once
+
+// Host build: just enough FreeRTOS for the firmware, on std::thread
+// primitives.  host_freertos.cpp has the bodies.
+
+#include <cstdint>
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdFALSE 0
+#define pdTRUE  1
+#define pdPASS  pdTRUE
+#define pdFAIL  pdFALSE
+#define portMAX_DELAY ((TickType_t)0xFFFFFFFF)
+
+#define pdMS_TO_TICKS(ms) \
+    ((TickType_t)((uint64_t)(ms) * CONFIG_FREERTOS_HZ / 1000))
+
+// There are no interrupts; ISR callbacks run on some other thread.
+#define portYIELD_FROM_ISR(woken) ((void)(woken))
+
+typedef struct HostTask *TaskHandle_t;
+
+// Tasks pinned to a core say so; everything else is on core 0.
+BaseType_t xPortGetCoreID();
+
+// ESP-IDF's FreeRTOS.h brings these in too.
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/timers.h"
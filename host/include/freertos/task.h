@@ -0,0 +1,36 @@
+#pragma once
+
+// Host build: each task is a thread.  Priorities and stack sizes
+// are ignored, and a task's core is only what xPortGetCoreID()
+// reports.
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void *);
+
+BaseType_t xTaskCreate(TaskFunction_t,
+                       const char *name,
+                       uint32_t stack_depth,
+                       void *parameters,
+                       UBaseType_t priority,
+                       TaskHandle_t *created_task);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t,
+                                   const char *name,
+                                   uint32_t stack_depth,
+                                   void *parameters,
+                                   UBaseType_t priority,
+                                   TaskHandle_t *created_task,
+                                   BaseType_t core_id);
+
+// Deleting another task waits for it to block in ulTaskNotifyTake(),
+// where it exits.  Tasks here only ever block there.
+void vTaskDelete(TaskHandle_t);
+
+void vTaskDelay(TickType_t ticks);
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_count_on_exit,
+                          TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t);
+void vTaskNotifyGiveFromISR(TaskHandle_t, BaseType_t *woken);
@@ -0,0 +1,19 @@
+#pragma once
+
+// Host build: each running software timer is a thread that sleeps
+// until the next period and calls the callback.
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct HostTimer *TimerHandle_t;
+typedef void (*TimerCallbackFunction_t)(TimerHandle_t);
+
+TimerHandle_t xTimerCreate(const char *name,
+                           TickType_t period,
+                           UBaseType_t auto_reload,
+                           void *timer_id,
+                           TimerCallbackFunction_t);
+BaseType_t xTimerStart(TimerHandle_t, TickType_t ticks_to_wait);
+BaseType_t xTimerStop(TimerHandle_t, TickType_t ticks_to_wait);
+BaseType_t xTimerDelete(TimerHandle_t, TickType_t ticks_to_wait);
+void *pvTimerGetTimerID(TimerHandle_t);
@@ -0,0 +1,7 @@
+#pragma once
+
+// Host build: what host_main.cpp took from the command line.
+
+// Refreshes to run in the headless loop benchmark.  Zero runs the
+// app forever, on the refresh clock.
+unsigned host_benchmark_refreshes();
@@ -0,0 +1,21 @@
+#pragma once
+
+// Host build configuration, standing in for the generated one.
+// The board is the round GC9A01 one.
+
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_IDF_TARGET "linux"
+#define CONFIG_BOARD_WAVESHARE_ESP32_S3_LCD_1_28 1
+#define CONFIG_SCREEN_PIXEL_BGR565 1
+#define CONFIG_SCREEN_PIXEL_FORMAT "bgr565"
+#define CONFIG_FREERTOS_HZ 100
+#define CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ 240
+
+#define CONFIG_DISPLAY_STRIPE_HEIGHT 8
+#define CONFIG_DISPLAY_TRANSACTION_POOL_SIZE 6
+#define CONFIG_DISPLAY_SPI_QUEUE_DEPTH 7
+#define CONFIG_DISPLAY_MAX_TRANSACTION_BYTES 16368
+
+// A bigger ring than the default, since memory is no object here.
+#define CONFIG_TRACE_ENABLE 1
+#define CONFIG_TRACE_EVENTS 16384
@@ -2,60 +2,236 @@
 #include "animation.h"
 
 // C++ standard headers
+#include <cstdio>
 #include <cstring>
 
 // ESP-IDF headers
+#include "esp_heap_caps.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 // Component headers
+#include "clip_cache.h"
+#include "crossfade.h"
+#include "dsp_memcpy.h"
 #include "flash_image.h"
+#include "playlist.h"
 #include "random.h"
+#include "trace.h"
 
-image_type DMA_ATTR Animation::s_image_buffers[IMAGE_BUFFER_COUNT];
+image_type *Animation::s_image_buffers;
 
-Animation::Animation(unsigned anim_frames, float change_prob)
+Animation::Animation(unsigned anim_frames,
+                     const Playlist& playlist,
+                     ClipCache& cache,
+                     float refresh_hz,
+                     FrameLoading loading,
+                     float dissolve_sec)
 : m_anim_frame_count(anim_frames),
-  m_soul_change_probability(change_prob),
-  m_in_intro(true),
-  m_current_frame(0),
-  m_current_image_buffer(0)
+  m_playlist(playlist),
+  m_cache(cache),
+  m_loading(loading),
+  m_refresh_period_usec(1'000'000 / refresh_hz),
+  m_frame_clock_usec(0),
+  m_catch_up_frames(0),
+  m_change_generation(0),
+  m_last_loaded_buffer(0),
+  m_display(nullptr),
+  m_change_requested(false),
+  m_requested_scene(Playlist::NO_SCENE),
+  m_requested_frame(0),
+  m_requests_posted(0),
+  m_random(RANDOM_STREAM_ANIMATION),
+  m_end_roll(m_random.rand()),
+  m_displayed_scene(Playlist::NO_SCENE),
+  m_displayed_image(nullptr),
+  m_displayed_generation(0),
+  m_current_image_buffer(0),
+  m_retired_image_buffer(NO_BUFFER),
+  m_frame_serial(0),
+  m_changed_stripes(0),
+  m_located_image(nullptr),
+  m_stripe_data{},
+  m_dissolve_refreshes(dissolve_sec * refresh_hz),
+  m_dissolve_step(0),
+  m_dissolve_handed_off(false),
+  m_dissolve_scene(Playlist::NO_SCENE),
+  m_dissolve_image(nullptr),
+  m_dissolve_frame(0),
+  m_dissolve_clock_usec(0),
+  m_dissolve_stripe_data{},
+  m_loader_task(nullptr),
+  m_late_frames(0),
+  m_frame_late(false),
+  m_visible(true)
 {
-    m_current_image = FlashImage::get_by_label("Intro");
-    assert(m_current_image != nullptr);
-    m_image_frame_count = m_current_image->frame_count();
+    // The frame buffers are ~230 KB of internal RAM.
+    // Don't allocate them unless we need them.  Align them for
+    // the crossfade kernel.
+    if (m_loading != STREAM_STRIPES) {
+        size_t size = IMAGE_BUFFER_COUNT * sizeof *s_image_buffers;
+        s_image_buffers = (image_type *)
+            heap_caps_aligned_alloc(DSP_ALIGNMENT, size, MALLOC_CAP_DMA);
+        assert(s_image_buffers);
+    }
+
+    for (auto& stale : m_stale_stripes) {
+        stale = all_stripes(FlashImage::STRIPE_COUNT);
+    }
+    for (auto& id : m_buffer_trans) {
+        id = NO_TRANSACTION;
+    }
+    set_cursor(m_playlist.first_scene(), 0);
+
+    // Show the first frame before returning.
+    if (m_loading == STREAM_STRIPES) {
+        locate_frame();
+    } else {
+        m_changed_stripes = load_frame(m_current_image_buffer);
+        m_displayed_scene = m_current_scene;
+        m_displayed_image = m_current_image;
+        m_frame_serial++;
+    }
+    advance_cursor();
 
-    load_frame(m_current_image_buffer);
+    if (m_loading == LOAD_IN_TASK) {
+        for (size_t i = 0; i < IMAGE_BUFFER_COUNT; i++) {
+            if (i != m_current_image_buffer) {
+                bool ok = m_free_buffers.push(i);
+                assert(ok);
+                (void)ok;
+            }
+        }
+        BaseType_t other_core = 1 - xPortGetCoreID();
+        BaseType_t ok = xTaskCreatePinnedToCore(
+            loader_task,
+            "frame_loader",
+            LOADER_STACK_SIZE,
+            this,
+            LOADER_PRIORITY,
+            &m_loader_task,
+            other_core);
+        assert(ok == pdPASS);
+        (void)ok;
+    }
+}
+
+Animation::~Animation()
+{
+    if (m_loader_task) {
+        vTaskDelete(m_loader_task);
+    }
+    heap_caps_free(s_image_buffers);
+    s_image_buffers = nullptr;
 }
 
 image_type *Animation::current_frame() const
 {
+    assert(m_loading != STREAM_STRIPES);
     return s_image_buffers + m_current_image_buffer;
 }
 
+const pixel_type *Animation::stripe(size_t y, pixel_type *scratch) const
+{
+    if (m_loading != STREAM_STRIPES) {
+        return (*current_frame())[y];
+    }
+    assert(y % FlashImage::STRIPE_HEIGHT == 0);
+    const uint8_t *data = m_stripe_data[y / FlashImage::STRIPE_HEIGHT];
+    m_located_image->read_stripe(data, scratch);
+    return scratch;
+}
+
+const image_type *Animation::next_frame(StripeMask *changed) const
+{
+    LoadedFrame next;
+    if (m_loading != LOAD_IN_TASK || !m_ready_frames.peek(next)) {
+        return nullptr;
+    }
+    *changed = next.changed;
+    return s_image_buffers + next.buffer;
+}
+
+unsigned Animation::dissolve_weight() const
+{
+    assert(m_dissolve_refreshes > 0);
+    return m_dissolve_step * CROSSFADE_WEIGHT_MAX / m_dissolve_refreshes;
+}
+
+const pixel_type *Animation::incoming_stripe(size_t y,
+                                             pixel_type *scratch) const
+{
+    assert(dissolving());
+    assert(y % FlashImage::STRIPE_HEIGHT == 0);
+    const uint8_t *data =
+        m_dissolve_stripe_data[y / FlashImage::STRIPE_HEIGHT];
+    m_dissolve_image->read_stripe(data, scratch);
+    return scratch;
+}
+
+unsigned Animation::fade_weight() const
+{
+    uint32_t period = m_displayed_image->frame_period_usec();
+    uint64_t weight = (uint64_t)m_frame_clock_usec * CROSSFADE_WEIGHT_MAX;
+    return weight / period;
+}
+
 void Animation::update()
 {
     maybe_change_animation();
-    // update the animation every 8 frames
-    static int frame;
-    frame = (frame + 1) % 8;
-    if (frame != 0) {
+    release_retired_buffer();
+
+    // Paused, the loader task stops when its buffers are full.
+    bool settled = !dissolving() && m_displayed_generation == m_requests_posted;
+    if (!m_visible && settled) {
+        return;
+    }
+
+    update_dissolve();
+
+    bool due = frame_due();
+    if (m_loading == LOAD_IN_TASK) {
+        // A late frame is shown as soon as it's ready.
+        if (due || m_frame_late) {
+            take_loaded_frame();
+        }
+        return;
+    }
+    if (!due) {
         return;
     }
 
     // printf("update animation frame %zu\n", m_current_frame);
-    size_t next_i_buf = (m_current_image_buffer + 1) % IMAGE_BUFFER_COUNT;
-    load_frame(next_i_buf);
-    m_current_image_buffer = next_i_buf;
+    apply_change_request();
+    if (m_loading == STREAM_STRIPES) {
+        locate_frame();
+    } else {
+        size_t next_i_buf = (m_current_image_buffer + 1) % IMAGE_BUFFER_COUNT;
+        await_buffer_reads(next_i_buf);
+        m_changed_stripes = load_frame(next_i_buf);
+        m_current_image_buffer = next_i_buf;
+        m_displayed_scene = m_current_scene;
+        m_displayed_image = m_current_image;
+        m_displayed_generation = m_change_generation;
+        m_frame_serial++;
+    }
+    advance_cursor();
+}
 
-    m_current_frame = (m_current_frame + 1) % m_image_frame_count;
-    if (m_current_frame == 0 && m_in_intro) {
-        // if we've finished the intro, start on one of the souls..
-        m_in_intro = false;
-        const char *next_image = Random::rand() % 2 ? "soul_f" : "soul_m";
-        m_current_image = FlashImage::get_by_label(next_image);
-        assert(m_current_image != nullptr);
-        m_image_frame_count = m_current_image->frame_count();
+// Advance the clock one refresh.  Is it time for the next frame?
+bool Animation::frame_due()
+{
+    uint32_t period = m_displayed_image->frame_period_usec();
+    m_frame_clock_usec += m_refresh_period_usec;
+    if (m_frame_clock_usec < period) {
+        return false;
+    }
+    m_frame_clock_usec -= period;
+    if (m_frame_clock_usec >= period) {
+        // The clip is faster than the screen.  Don't try to catch up.
+        m_frame_clock_usec = 0;
     }
+    return true;
 }
 
 void Animation::maybe_change_animation()
@@ -66,31 +242,258 @@ void Animation::maybe_change_animation()
         return;
     }
 
-    if (Random::randint(0, 1000) < 1000.0f * m_soul_change_probability) {
-        auto old_label = m_current_image->label();
+    if (m_loading == LOAD_IN_TASK) {
+        printf("Animation: %u late frames, %zu frames queued\n",
+               m_late_frames, queued_frame_count());
+    }
+    m_cache.log_stats();
 
-        // Don't interrupt the intro.
-        if (!std::strcmp(old_label, "Intro")) {
-            return;
-        }
-        const char *new_label;
-        if (!std::strcmp(old_label, "soul_m")) {
-            new_label = "soul_f";
-        } else {
-            assert(strcmp(old_label, "soul_f") == 0);
-            new_label = "soul_m";
+    m_end_roll.store(m_random.rand(), std::memory_order_relaxed);
+
+    // The cursor owner hasn't taken the last request yet.
+    if (m_change_requested.load(std::memory_order_acquire) || dissolving()) {
+        return;
+    }
+    float chance = m_random.uniform();
+    size_t scene = m_playlist.after_flicker_loop(m_displayed_scene,
+                                                 chance,
+                                                 m_random.rand());
+    if (scene == Playlist::NO_SCENE) {
+        return;
+    }
+    size_t frame_count = m_playlist.clip(scene)->frame_count();
+    size_t start_frame = m_random.randint(0, frame_count);
+    if (m_dissolve_refreshes) {
+        start_dissolve(scene, start_frame);
+    } else {
+        post_change_request(scene, start_frame);
+    }
+}
+
+void Animation::post_change_request(size_t scene, size_t frame)
+{
+    m_requested_scene = scene;
+    m_requested_frame = frame;
+    m_requests_posted++;
+    m_change_requested.store(true, std::memory_order_release);
+}
+
+void Animation::start_dissolve(size_t scene, size_t frame)
+{
+    m_dissolve_scene = scene;
+    m_dissolve_image = m_playlist.clip(scene);
+    m_dissolve_frame = m_dissolve_image->keyframe_at_or_before(frame);
+    m_dissolve_image->locate_stripes(m_dissolve_frame, m_dissolve_stripe_data);
+    m_dissolve_step = 0;
+    m_dissolve_clock_usec = 0;
+    m_dissolve_handed_off = false;
+}
+
+// Fade the incoming clip in.  Then hand it to the cursor and keep
+// showing it until the cursor's frames reach the screen.
+void Animation::update_dissolve()
+{
+    if (!dissolving()) {
+        return;
+    }
+    size_t frame_count = m_dissolve_image->frame_count();
+    if (m_dissolve_step < m_dissolve_refreshes) {
+        m_dissolve_step++;
+    } else if (!m_dissolve_handed_off) {
+        // Frames already loaded will be shown first.
+        size_t lead = 1;
+        if (m_loading == LOAD_IN_TASK) {
+            lead += queued_frame_count();
         }
-        m_current_image = FlashImage::get_by_label(new_label);
-        assert(m_current_image != nullptr);
-        m_image_frame_count = m_current_image->frame_count();
-        m_current_frame = Random::randint(0, m_image_frame_count);
+        post_change_request(m_dissolve_scene,
+                            (m_dissolve_frame + lead) % frame_count);
+        m_dissolve_handed_off = true;
+    } else if (m_displayed_generation == m_requests_posted) {
+        m_dissolve_image = nullptr;
+        return;
+    }
+
+    // The incoming clip plays at its own rate.
+    uint32_t period = m_dissolve_image->frame_period_usec();
+    m_dissolve_clock_usec += m_refresh_period_usec;
+    if (m_dissolve_clock_usec >= period) {
+        m_dissolve_clock_usec -= period;
+        m_dissolve_frame = (m_dissolve_frame + 1) % frame_count;
+        m_dissolve_image->locate_stripes(m_dissolve_frame,
+                                         m_dissolve_stripe_data);
+    }
+}
+
+// Runs wherever the cursor lives.  Delta frames can only be decoded
+// from a keyframe, so seek there and catch up in the next load.
+void Animation::apply_change_request()
+{
+    if (!m_change_requested.load(std::memory_order_acquire)) {
+        return;
+    }
+    const FlashImage *image = m_playlist.clip(m_requested_scene);
+    size_t keyframe = image->keyframe_at_or_before(m_requested_frame);
+    set_cursor(m_requested_scene, keyframe);
+    m_catch_up_frames = m_requested_frame - keyframe;
+    m_change_generation++;
+    m_change_requested.store(false, std::memory_order_release);
+}
+
+void Animation::set_cursor(size_t scene, size_t frame)
+{
+    m_current_scene = scene;
+    m_current_image = m_playlist.clip(scene);
+    m_image_frame_count = m_current_image->frame_count();
+    m_current_frame = frame;
+}
+
+void Animation::advance_cursor()
+{
+    if (++m_current_frame < m_image_frame_count) {
+        return;
     }
+    uint32_t roll = m_end_roll.load(std::memory_order_relaxed);
+    set_cursor(m_playlist.after_end(m_current_scene, roll), 0);
 }
 
-void Animation::load_frame(size_t buffer_index)
+// Returns the stripes that changed.
+StripeMask Animation::load_frame(size_t buffer_index)
 {
+    Trace::Span span(TRACE_LOAD_FRAME, m_current_frame);
     image_type *dest = s_image_buffers + buffer_index;
-    const image_type *src = m_current_image->frame_addr(m_current_frame);
-    size_t size = sizeof *dest;
-    std::memcpy((void *)dest, (void *)src, size);
-}
\ No newline at end of file
+    const image_type *prev = s_image_buffers + m_last_loaded_buffer;
+    StripeMask changed = m_current_image->frame_stripe_mask(m_current_frame);
+
+    // Catch up on stripes that changed while this buffer wasn't
+    // being loaded and that this frame doesn't replace.
+    StripeMask stale = m_stale_stripes[buffer_index] & ~changed;
+    if (stale && dest != prev) {
+        const size_t H = FlashImage::STRIPE_HEIGHT;
+        for (size_t stripe = 0; stripe < FlashImage::STRIPE_COUNT; stripe++) {
+            if (stale & stripe_bit(stripe)) {
+                std::memcpy((void *)(*dest)[stripe * H],
+                            (const void *)(*prev)[stripe * H],
+                            sizeof (image_row_type) * H);
+            }
+        }
+    }
+
+    for (; m_catch_up_frames; m_catch_up_frames--) {
+        const uint8_t *cached = m_cache.frame_data(m_current_image,
+                                                   m_current_frame);
+        m_current_image->read_frame(m_current_frame++, dest, cached);
+    }
+    const uint8_t *cached = m_cache.frame_data(m_current_image,
+                                               m_current_frame);
+    m_current_image->read_frame(m_current_frame, dest, cached);
+
+    for (size_t i = 0; i < IMAGE_BUFFER_COUNT; i++) {
+        m_stale_stripes[i] |= changed;
+    }
+    m_stale_stripes[buffer_index] = 0;
+    m_last_loaded_buffer = buffer_index;
+    return changed;
+}
+
+// Streaming doesn't copy anything.  It just notes where the
+// changed stripes are.  A clip change always starts on a keyframe,
+// so every stripe comes from the same clip.
+void Animation::locate_frame()
+{
+    StripeMask changed = m_current_image->frame_stripe_mask(m_current_frame);
+    assert(m_current_image == m_located_image ||
+           changed == all_stripes(FlashImage::STRIPE_COUNT));
+    for (; m_catch_up_frames; m_catch_up_frames--) {
+        const uint8_t *cached = m_cache.frame_data(m_current_image,
+                                                   m_current_frame);
+        m_current_image->locate_stripes(m_current_frame++,
+                                        m_stripe_data,
+                                        cached);
+    }
+    const uint8_t *cached = m_cache.frame_data(m_current_image,
+                                               m_current_frame);
+    m_current_image->locate_stripes(m_current_frame, m_stripe_data, cached);
+    m_located_image = m_current_image;
+    m_displayed_scene = m_current_scene;
+    m_displayed_image = m_current_image;
+    m_displayed_generation = m_change_generation;
+    m_changed_stripes = changed;
+    m_frame_serial++;
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Loader Task
+
+void Animation::take_loaded_frame()
+{
+    LoadedFrame loaded;
+    if (!m_ready_frames.pop(loaded)) {
+        // Keep showing this frame.  Try again next refresh.
+        if (!m_frame_late) {
+            m_late_frames++;
+            m_frame_late = true;
+        }
+        return;
+    }
+    m_frame_late = false;
+
+    // The streamer may still be sending stripes from the old buffer
+    // this refresh, so give it back to the loader on the next one,
+    // once the display has finished reading it.
+    assert(m_retired_image_buffer == NO_BUFFER);
+    m_retired_image_buffer = m_current_image_buffer;
+    m_current_image_buffer = loaded.buffer;
+    m_displayed_scene = loaded.scene;
+    m_displayed_image = m_playlist.clip(loaded.scene);
+    m_displayed_generation = loaded.generation;
+    m_changed_stripes = loaded.changed;
+    m_frame_serial++;
+}
+
+void Animation::release_retired_buffer()
+{
+    if (m_retired_image_buffer == NO_BUFFER) {
+        return;
+    }
+    await_buffer_reads(m_retired_image_buffer);
+    bool ok = m_free_buffers.push(m_retired_image_buffer);
+    assert(ok);
+    (void)ok;
+    m_retired_image_buffer = NO_BUFFER;
+    xTaskNotifyGive(m_loader_task);
+}
+
+void Animation::await_buffer_reads(size_t buffer)
+{
+    if (m_display) {
+        m_display->await_transaction(m_buffer_trans[buffer]);
+    }
+    m_buffer_trans[buffer] = NO_TRANSACTION;
+}
+
+void Animation::loader_task(void *arg)
+{
+    ((Animation *)arg)->loader_loop();
+}
+
+void Animation::loader_loop()
+{
+    while (true) {
+        size_t buffer;
+        while (!m_free_buffers.pop(buffer)) {
+            (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        apply_change_request();
+        LoadedFrame loaded = {
+            .buffer = buffer,
+            .scene = m_current_scene,
+            .generation = m_change_generation,
+            .changed = load_frame(buffer),
+        };
+        advance_cursor();
+        bool ok = m_ready_frames.push(loaded);
+        assert(ok);
+        (void)ok;
+    }
+}
@@ -2,18 +2,30 @@
 #include "benchmarks.h"
 
 // C++ standard headers
+#include <algorithm>
+#include <cassert>
+#include <cinttypes>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <vector>
 
 // ESP-IDF headers
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
 #include "esp_timer.h"
+#include "sdkconfig.h"
 
 // Component headers
+#include "crossfade.h"
 #include "dsp_memcpy.h"
 #include "flash_image.h"
 #include "memory_dma.h"
+#include "noise.h"
+#include "pixel_types.h"
+#include "spi_display.h"
 
 // Should benchmark
 //   SOURCES X DESTINATIONS X ALGORITHMS
@@ -22,6 +34,10 @@
 //   algorithms: std::memcpy, DMA, DSP memcpy
 //   3 * 2 * 3 = 18
 
+// DISPLAY_PIXEL_ENDIAN expands to PixelEndian::BIG, which can't be
+// used below the BIG macro.
+static const PixelEndian PIXEL_ENDIAN = DISPLAY_PIXEL_ENDIAN;
+
 #define IN_FLIGHT 4
 #define REPS 100
 #define BIG (240 * 240 * sizeof (uint16_t))
@@ -124,17 +140,17 @@ const uint8_t EXT_RAM_BSS_ATTR DSP_ALIGNED_ATTR PSRAMSource::s_memory[BIG] = {};
 class FlashSource : public Source {
 public:
     FlashSource()
-    : m_image(FlashImage::get_by_index(0)),
-        m_frame_count(m_image->frame_count())
+    : m_image(FlashImage::get_by_index(0))
     {}
     const char *label() const override { return "flash"; }
     const void *addr(size_t index) const override
     {
-        return (const void *)m_image->frame_addr(index % m_frame_count);
+        // The clip may be compressed, so just walk the partition.
+        size_t offset = index * BIG % (m_image->size_bytes() - BIG);
+        return (const uint8_t *)m_image->base_addr() + offset;
     }
 private:
     FlashImage *m_image;
-    size_t m_frame_count;
 };
 
 class SRAMDestination : public Destination {
@@ -204,7 +220,7 @@ void run_one_benchmark(Source *source, Destination *destination, Algorithm *algo
         printf("===== ===== ======== | ======== ======= ====== ======\n");
         been_here = true;
     }
-    printf("%-5s %-5s %-8s | %7zu %7lld %6.4g %6.4g\n",
+    printf("%-5s %-5s %-8s | %7zu %7" PRId64 " %6.4g %6.4g\n",
             source->label(),
             destination->label(),
             algo->label(),
@@ -246,3 +262,407 @@ void run_memcpy_benchmarks()
     for (auto& src : sources) { delete src; src = nullptr; }
     for (auto& dest : destinations) { delete dest; dest = nullptr; }
 }
+
+// Compare decoding each clip with memcpying raw frames from flash.
+void run_decode_benchmarks()
+{
+    static image_type DMA_ATTR dest;
+
+    printf("Clip     Codec  | Flash B/frame    uSec   MB/s    FPS\n");
+    printf("======== ====== | ============= ======= ====== ======\n");
+
+    for (size_t i = 0; FlashImage *image = FlashImage::get_by_index(i); i++) {
+        const char *codec_names[] = { "raw", "rle", "delta" };
+        size_t frame_count = image->frame_count();
+
+        // The baseline: what `Animation::load_frame` used to do.
+        int64_t before = esp_timer_get_time();
+        for (size_t rep = 0; rep < REPS; rep++) {
+            size_t offset = rep * BIG % (image->size_bytes() - BIG);
+            auto src = (const uint8_t *)image->base_addr() + offset;
+            std::memcpy((void *)&dest, src, BIG);
+        }
+        int64_t memcpy_usec = esp_timer_get_time() - before;
+
+        size_t flash_bytes = 0;
+        before = esp_timer_get_time();
+        for (size_t rep = 0; rep < REPS; rep++) {
+            size_t frame = rep % frame_count;
+            image->read_frame(frame, &dest);
+            flash_bytes += image->frame_data_size(frame);
+        }
+        int64_t decode_usec = esp_timer_get_time() - before;
+
+        const char *codec_name = codec_names[(size_t)image->codec()];
+        int64_t usecs[2] = { memcpy_usec, decode_usec };
+        size_t bytes[2] = { BIG, flash_bytes / REPS };
+        const char *names[2] = { "memcpy", codec_name };
+        for (size_t row = 0; row < 2; row++) {
+            float MBps = (float)(REPS * BIG) / (float)usecs[row];
+            float fps = (float)REPS / (float)usecs[row] * 1'000'000.0f;
+            printf("%-8s %-6s | %13zu %7" PRId64 " %6.4g %6.4g\n",
+                   image->label(),
+                   names[row],
+                   bytes[row],
+                   usecs[row],
+                   MBps,
+                   fps);
+        }
+    }
+}
+
+// Time the crossfade kernels over a whole frame, one stripe at a time,
+// and check the PIE kernel against the reference.
+void run_crossfade_benchmarks()
+{
+    const size_t STRIPE_PIXELS = SPIDisplay::STRIPE_HEIGHT * IMAGE_WIDTH;
+    const size_t STRIPES = IMAGE_HEIGHT / SPIDisplay::STRIPE_HEIGHT;
+    const float BUDGET_USEC = 1'000'000.0f / 60.0f;
+    static pixel_type DMA_ATTR DSP_ALIGNED_ATTR a[STRIPE_PIXELS];
+    static pixel_type DMA_ATTR DSP_ALIGNED_ATTR b[STRIPE_PIXELS];
+    static pixel_type DMA_ATTR DSP_ALIGNED_ATTR d[2][STRIPE_PIXELS];
+
+    for (size_t i = 0; i < STRIPE_PIXELS; i++) {
+        a[i] = pixel_type::from_grey8(i);
+        b[i] = pixel_type(i * 3, i * 5, i * 7);
+    }
+
+    typedef void kernel_fn(void *, const void *, const void *,
+                           size_t, unsigned, PixelEndian);
+    kernel_fn *kernels[2] = { crossfade_565_reference, crossfade_565 };
+    const char *names[2] = { "reference", "PIE" };
+
+    printf("Kernel    | uSec/frame  %% of 60 Hz\n");
+    printf("========= | ========== ==========\n");
+    for (size_t k = 0; k < 2; k++) {
+        int64_t before = esp_timer_get_time();
+        for (size_t rep = 0; rep < REPS; rep++) {
+            for (size_t stripe = 0; stripe < STRIPES; stripe++) {
+                unsigned weight = (rep + stripe) % CROSSFADE_WEIGHT_MAX;
+                (*kernels[k])(d[k], a, b, STRIPE_PIXELS,
+                              weight, PIXEL_ENDIAN);
+            }
+        }
+        float usec = (float)(esp_timer_get_time() - before) / REPS;
+        printf("%-9s | %10.1f %9.1f%%\n",
+               names[k], usec, 100.0f * usec / BUDGET_USEC);
+    }
+
+    size_t mismatches = 0;
+    for (unsigned w = 0; w <= CROSSFADE_WEIGHT_MAX; w++) {
+        for (size_t k = 0; k < 2; k++) {
+            (*kernels[k])(d[k], a, b, STRIPE_PIXELS, w, PIXEL_ENDIAN);
+        }
+        if (std::memcmp(d[0], d[1], sizeof d[0])) {
+            mismatches++;
+        }
+    }
+    printf("crossfade: %zu of %u weights differ from reference\n",
+           mismatches, CROSSFADE_WEIGHT_MAX + 1);
+}
+
+void run_noise_benchmarks()
+{
+    const size_t STRIPE_PIXELS = SPIDisplay::STRIPE_HEIGHT * IMAGE_WIDTH;
+    const size_t STRIPES = IMAGE_HEIGHT / SPIDisplay::STRIPE_HEIGHT;
+    static pixel_type DMA_ATTR DSP_ALIGNED_ATTR d[2][STRIPE_PIXELS];
+
+    // The loop send_static_stripe() used to run.
+    int64_t before = esp_timer_get_time();
+    for (size_t rep = 0; rep < REPS; rep++) {
+        for (size_t stripe = 0; stripe < STRIPES; stripe++) {
+            for (size_t i = 0; i < STRIPE_PIXELS; i += 4) {
+                int x = std::rand();
+                d[0][i + 0] = pixel_type::from_grey8(x >> 0 & 0xFF);
+                d[0][i + 1] = pixel_type::from_grey8(x >> 8 & 0xFF);
+                d[0][i + 2] = pixel_type::from_grey8(x >> 16 & 0xFF);
+                d[0][i + 3] = pixel_type::from_grey8(x >> 23 & 0xFF);
+            }
+        }
+    }
+    float loop_usec = (float)(esp_timer_get_time() - before) / REPS;
+
+    NoiseGenerator gens[2] = { NoiseGenerator(1), NoiseGenerator(1) };
+    float usec[2];
+    before = esp_timer_get_time();
+    for (size_t rep = 0; rep < REPS; rep++) {
+        for (size_t stripe = 0; stripe < STRIPES; stripe++) {
+            gens[0].fill_565_reference(d[0], STRIPE_PIXELS, PIXEL_ENDIAN);
+        }
+    }
+    usec[0] = (float)(esp_timer_get_time() - before) / REPS;
+    before = esp_timer_get_time();
+    for (size_t rep = 0; rep < REPS; rep++) {
+        for (size_t stripe = 0; stripe < STRIPES; stripe++) {
+            gens[1].fill_565(d[1], STRIPE_PIXELS, PIXEL_ENDIAN);
+        }
+    }
+    usec[1] = (float)(esp_timer_get_time() - before) / REPS;
+
+    printf("Generator | uSec/frame\n");
+    printf("========= | ==========\n");
+    printf("%-9s | %10.1f\n", "rand loop", loop_usec);
+    printf("%-9s | %10.1f\n", "reference", usec[0]);
+    printf("%-9s | %10.1f\n", "PIE", usec[1]);
+
+    const size_t BANK_BYTES = 32 * 1024;
+    void *bank_storage = heap_caps_aligned_alloc(DSP_ALIGNMENT,
+                                                 BANK_BYTES,
+                                                 MALLOC_CAP_INTERNAL);
+    if (bank_storage) {
+        NoiseBank bank(bank_storage, BANK_BYTES, IMAGE_WIDTH,
+                       PIXEL_ENDIAN, 1);
+        before = esp_timer_get_time();
+        for (size_t rep = 0; rep < REPS; rep++) {
+            for (size_t stripe = 0; stripe < STRIPES; stripe++) {
+                bank.fill_565(d[0], SPIDisplay::STRIPE_HEIGHT);
+            }
+        }
+        float bank_usec = (float)(esp_timer_get_time() - before) / REPS;
+        printf("%-9s | %10.1f\n", "bank", bank_usec);
+        heap_caps_free(bank_storage);
+    }
+
+    // Both generators have made the same number of pixels, so they
+    // should agree from here on.
+    size_t mismatches = 0;
+    for (size_t stripe = 0; stripe < STRIPES; stripe++) {
+        gens[0].fill_565_reference(d[0], STRIPE_PIXELS, PIXEL_ENDIAN);
+        gens[1].fill_565(d[1], STRIPE_PIXELS, PIXEL_ENDIAN);
+        if (std::memcmp(d[0], d[1], sizeof d[0])) {
+            mismatches++;
+        }
+    }
+    printf("noise: %zu of %zu stripes differ from reference\n",
+           mismatches, STRIPES);
+}
+
+// Static overlay: noise into one stripe buffer, added to the image
+// in another, for every stripe in a frame.
+void run_overlay_benchmarks()
+{
+    const size_t STRIPE_PIXELS = SPIDisplay::STRIPE_HEIGHT * IMAGE_WIDTH;
+    const size_t STRIPES = IMAGE_HEIGHT / SPIDisplay::STRIPE_HEIGHT;
+    const uint32_t BUDGET_CYCLES =
+        CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ * 1'000'000 / 60;
+    static pixel_type DMA_ATTR DSP_ALIGNED_ATTR image[STRIPE_PIXELS];
+    static pixel_type DMA_ATTR DSP_ALIGNED_ATTR noise[STRIPE_PIXELS];
+    static pixel_type DMA_ATTR DSP_ALIGNED_ATTR d[2][STRIPE_PIXELS];
+
+    for (size_t i = 0; i < STRIPE_PIXELS; i++) {
+        image[i] = pixel_type(i * 3, i * 5, i * 7);
+    }
+
+    const size_t BANK_BYTES = 32 * 1024;
+    void *bank_storage = heap_caps_aligned_alloc(DSP_ALIGNMENT,
+                                                 BANK_BYTES,
+                                                 MALLOC_CAP_INTERNAL);
+    assert(bank_storage);
+    NoiseBank bank(bank_storage, BANK_BYTES, IMAGE_WIDTH, PIXEL_ENDIAN, 1);
+
+    typedef void kernel_fn(void *, const void *, const void *,
+                           size_t, unsigned, PixelEndian);
+    kernel_fn *kernels[2] = { add_565_reference, add_565 };
+    const char *names[2] = { "reference", "PIE" };
+
+    printf("Kernel    | cycles/frame  %% of 60 Hz\n");
+    printf("========= | ============ ==========\n");
+    for (size_t k = 0; k < 2; k++) {
+        uint32_t worst = 0;
+        uint64_t total = 0;
+        for (size_t rep = 0; rep < REPS; rep++) {
+            uint32_t before = esp_cpu_get_cycle_count();
+            for (size_t stripe = 0; stripe < STRIPES; stripe++) {
+                unsigned weight = (rep + stripe) % CROSSFADE_WEIGHT_MAX + 1;
+                bank.fill_565(noise, SPIDisplay::STRIPE_HEIGHT);
+                (*kernels[k])(d[k], image, noise, STRIPE_PIXELS,
+                              weight, PIXEL_ENDIAN);
+            }
+            uint32_t cycles = esp_cpu_get_cycle_count() - before;
+            total += cycles;
+            worst = std::max(worst, cycles);
+        }
+        uint32_t mean = total / REPS;
+        printf("%-9s | %12lu %9.1f%%  (worst %lu)\n",
+               names[k],
+               (unsigned long)mean,
+               100.0f * mean / BUDGET_CYCLES,
+               (unsigned long)worst);
+    }
+    heap_caps_free(bank_storage);
+
+    size_t mismatches = 0;
+    for (unsigned w = 0; w <= CROSSFADE_WEIGHT_MAX; w++) {
+        for (size_t k = 0; k < 2; k++) {
+            (*kernels[k])(d[k], image, noise, STRIPE_PIXELS, w, PIXEL_ENDIAN);
+        }
+        if (std::memcmp(d[0], d[1], sizeof d[0])) {
+            mismatches++;
+        }
+    }
+    printf("overlay: %zu of %u weights differ from reference\n",
+           mismatches, CROSSFADE_WEIGHT_MAX + 1);
+}
+
+// Send frames two ways and count what the CPU gets back.
+//   blocking - send_stripe() each stripe, sleeping when the
+//              transaction pool is full.
+//   overlap  - try_send_stripe(), doing a slice of other work
+//              whenever the pool is full.
+// The work slices done per frame, times what one costs alone, is
+// the CPU time recovered per frame.
+void run_display_benchmarks(SPIDisplay& display)
+{
+    const size_t STRIPE_PIXELS = SPIDisplay::STRIPE_HEIGHT * IMAGE_WIDTH;
+    const size_t H = SPIDisplay::STRIPE_HEIGHT;
+    const size_t SLICE_PIXELS = 64;
+    static pixel_type DMA_ATTR DSP_ALIGNED_ATTR stripe[STRIPE_PIXELS];
+    static pixel_type DMA_ATTR DSP_ALIGNED_ATTR work[SLICE_PIXELS];
+
+    auto slice = [&] {
+        crossfade_565_reference(work, work, stripe, SLICE_PIXELS, 7,
+                                PIXEL_ENDIAN);
+    };
+
+    int64_t before = esp_timer_get_time();
+    for (size_t rep = 0; rep < REPS * 10; rep++) {
+        slice();
+    }
+    float slice_usec = (float)(esp_timer_get_time() - before) / (REPS * 10);
+
+    int64_t blocked = 0;
+    before = esp_timer_get_time();
+    for (size_t rep = 0; rep < REPS; rep++) {
+        TransactionID id = NO_TRANSACTION;
+        display.begin_frame_centered(IMAGE_WIDTH, IMAGE_HEIGHT);
+        for (size_t y = 0; y < IMAGE_HEIGHT; y += H) {
+            int64_t t = esp_timer_get_time();
+            id = display.send_stripe(y, H, stripe);
+            blocked += esp_timer_get_time() - t;
+        }
+        display.end_frame();
+        display.await_transaction(id);
+    }
+    float blocking_usec = (float)(esp_timer_get_time() - before) / REPS;
+
+    size_t slices = 0;
+    before = esp_timer_get_time();
+    for (size_t rep = 0; rep < REPS; rep++) {
+        TransactionID id = NO_TRANSACTION;
+        display.begin_frame_centered(IMAGE_WIDTH, IMAGE_HEIGHT);
+        for (size_t y = 0; y < IMAGE_HEIGHT; y += H) {
+            while ((id = display.try_send_stripe(y, H, stripe)) ==
+                   NO_TRANSACTION) {
+                slice();
+                slices++;
+            }
+        }
+        display.end_frame();
+        while (!display.transaction_done(id)) {
+            slice();
+            slices++;
+        }
+    }
+    float overlap_usec = (float)(esp_timer_get_time() - before) / REPS;
+
+    printf("Display   | uSec/frame  in send_stripe  recovered\n");
+    printf("========= | ==========  =============  =========\n");
+    printf("%-9s | %10.1f  %13.1f\n",
+           "blocking", blocking_usec, (float)blocked / REPS);
+    printf("%-9s | %10.1f  %13s  %9.1f\n",
+           "overlap", overlap_usec, "", slices * slice_usec / REPS);
+}
+
+// Sweep stripe height, merging and transactions in flight, sending
+// a whole frame buffer with try_send_stripe() and doing slices of
+// other work while the display is busy, as above.  The CPU column
+// is the frame time the slices didn't get back: driver, interrupt
+// and merging overhead.
+void run_transfer_sweep_benchmarks(SPIDisplay& display)
+{
+    const size_t FRAME_BYTES = IMAGE_HEIGHT * IMAGE_WIDTH * sizeof (pixel_type);
+    const size_t SLICE_PIXELS = 64;
+    const size_t heights[] = {4, 8, 16, 24, 48};
+    const size_t merge_limits[] = {0, SPIDisplay::MAX_TRANSACTION_BYTES};
+    const size_t max_in_flight =
+        std::min<size_t>(SPIDisplay::TRANSACTION_POOL_SIZE,
+                         SPIDisplay::SPI_QUEUE_DEPTH);
+    const size_t in_flights[] = {1, 2, 4, max_in_flight};
+    static pixel_type DMA_ATTR DSP_ALIGNED_ATTR work[SLICE_PIXELS];
+
+    auto *frame = (pixel_type *)heap_caps_aligned_alloc(
+        DSP_ALIGNMENT, FRAME_BYTES, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    if (frame == nullptr) {
+        printf("transfer sweep: no room for a frame buffer\n");
+        return;
+    }
+    std::memset(frame, 0, FRAME_BYTES);
+
+    auto slice = [&] {
+        crossfade_565_reference(work, work, frame, SLICE_PIXELS, 7,
+                                PIXEL_ENDIAN);
+    };
+
+    int64_t before = esp_timer_get_time();
+    for (size_t rep = 0; rep < REPS * 10; rep++) {
+        slice();
+    }
+    float slice_usec = (float)(esp_timer_get_time() - before) / (REPS * 10);
+
+    printf("Height  Merge  In flight | trans/frame  uSec/frame   MB/sec"
+           "  CPU uSec   CPU %%\n");
+    printf("======  =====  ========= | ===========  ==========  ======="
+           "  ========  ======\n");
+    for (size_t h : heights) {
+        size_t stripe_bytes = h * IMAGE_WIDTH * sizeof (pixel_type);
+        if (IMAGE_HEIGHT % h || stripe_bytes > SPIDisplay::MAX_TRANSACTION_BYTES) {
+            continue;
+        }
+        for (size_t merge : merge_limits) {
+            size_t prev = 0;
+            for (size_t in_flight : in_flights) {
+                if (in_flight > max_in_flight || in_flight == prev) {
+                    continue;
+                }
+                prev = in_flight;
+                display.set_transfer_limits(in_flight, merge);
+                size_t count = display.transaction_count();
+                size_t slices = 0;
+                before = esp_timer_get_time();
+                for (size_t rep = 0; rep < REPS; rep++) {
+                    TransactionID id = NO_TRANSACTION;
+                    display.begin_frame_centered(IMAGE_WIDTH, IMAGE_HEIGHT);
+                    for (size_t y = 0; y < IMAGE_HEIGHT; y += h) {
+                        const pixel_type *stripe = frame + y * IMAGE_WIDTH;
+                        while ((id = display.try_send_stripe(y, h, stripe)) ==
+                               NO_TRANSACTION) {
+                            slice();
+                            slices++;
+                        }
+                    }
+                    display.end_frame();
+                    while (!display.transaction_done(id)) {
+                        slice();
+                        slices++;
+                    }
+                }
+                int64_t usec = esp_timer_get_time() - before;
+                float frame_usec = (float)usec / REPS;
+                float cpu_usec = frame_usec - slices * slice_usec / REPS;
+                printf("%6zu  %5s  %9zu | %11.1f  %10.1f  %7.2f"
+                       "  %8.1f  %5.1f%%\n",
+                       h,
+                       merge ? "yes" : "no",
+                       in_flight,
+                       (float)(display.transaction_count() - count) / REPS,
+                       frame_usec,
+                       (float)FRAME_BYTES * REPS / usec,
+                       cpu_usec,
+                       100.0f * cpu_usec / frame_usec);
+            }
+        }
+    }
+    display.set_transfer_limits(max_in_flight,
+                                SPIDisplay::MAX_TRANSACTION_BYTES);
+    heap_caps_free(frame);
+}
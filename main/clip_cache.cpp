@@ -0,0 +1,147 @@
+// This file's header
+#include "clip_cache.h"
+
+// C++ standard headers
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+// ESP-IDF headers
+#include "esp_heap_caps.h"
+
+// Component headers
+#include "flash_image.h"
+
+ClipCache::ClipCache(size_t max_bytes)
+: m_buffer(nullptr),
+  m_capacity(0),
+  m_wanted(nullptr),
+  m_cached(nullptr),
+  m_ready_frames(0),
+  m_fill_task(nullptr),
+  m_hits(0),
+  m_misses(0)
+{
+    if (max_bytes == 0) {
+        return;
+    }
+    size_t largest = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM);
+    m_capacity = std::min(max_bytes, largest);
+    if (m_capacity) {
+        m_buffer = (uint8_t *)heap_caps_malloc(m_capacity, MALLOC_CAP_SPIRAM);
+    }
+    if (!m_buffer) {
+        printf("ClipCache: no PSRAM.  Disabled.\n");
+        m_capacity = 0;
+        return;
+    }
+    printf("ClipCache: %zu bytes\n", m_capacity);
+
+    // Stay off the refresh loop's core.  The frame loader, on the
+    // other core, outranks it.
+    BaseType_t other_core = 1 - xPortGetCoreID();
+    BaseType_t ok = xTaskCreatePinnedToCore(
+        fill_task,
+        "clip_cache",
+        FILL_STACK_SIZE,
+        this,
+        FILL_PRIORITY,
+        &m_fill_task,
+        other_core);
+    assert(ok == pdPASS);
+    (void)ok;
+}
+
+ClipCache::~ClipCache()
+{
+    if (m_fill_task) {
+        vTaskDelete(m_fill_task);
+    }
+    heap_caps_free(m_buffer);
+}
+
+const uint8_t *ClipCache::frame_data(const FlashImage *image, size_t i)
+{
+    if (!m_buffer) {
+        return nullptr;
+    }
+    if (m_wanted.load(std::memory_order_relaxed) != image) {
+        m_wanted.store(image, std::memory_order_release);
+        xTaskNotifyGive(m_fill_task);
+    }
+
+    // The filler clears m_ready_frames before it changes m_cached,
+    // so check them in this order.
+    if (m_cached.load(std::memory_order_acquire) == image &&
+        i < m_ready_frames.load(std::memory_order_acquire)) {
+        m_hits++;
+        return m_buffer + (image->frame_data(i) - image->frame_data(0));
+    }
+    m_misses++;
+    return nullptr;
+}
+
+void ClipCache::log_stats() const
+{
+    if (!m_buffer) {
+        return;
+    }
+    const FlashImage *image = m_cached.load(std::memory_order_acquire);
+    printf("ClipCache: %s: %zu/%zu frames, %u hits, %u misses\n",
+           image ? image->label() : "(none)",
+           m_ready_frames.load(std::memory_order_relaxed),
+           image ? image->frame_count() : 0,
+           m_hits,
+           m_misses);
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Fill Task
+
+void ClipCache::fill_task(void *arg)
+{
+    ((ClipCache *)arg)->fill_loop();
+}
+
+void ClipCache::fill_loop()
+{
+    while (true) {
+        const FlashImage *wanted;
+        while ((wanted = m_wanted.load(std::memory_order_acquire)) ==
+               m_cached.load(std::memory_order_relaxed)) {
+            (void)ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        }
+        fill(wanted);
+    }
+}
+
+// Copy one frame at a time so the reader can start using the
+// first frames right away, and so a newly wanted clip doesn't wait
+// for this one to finish.
+void ClipCache::fill(const FlashImage *image)
+{
+    // Evict.
+    m_ready_frames.store(0, std::memory_order_release);
+    m_cached.store(image, std::memory_order_release);
+
+    const uint8_t *base = image->frame_data(0);
+    size_t frame_count = image->frame_count();
+    size_t i;
+    for (i = 0; i < frame_count; i++) {
+        if (m_wanted.load(std::memory_order_acquire) != image) {
+            return;
+        }
+        const uint8_t *src = image->frame_data(i);
+        size_t offset = src - base;
+        size_t size = image->frame_data_size(i);
+        if (offset + size > m_capacity) {
+            break;
+        }
+        std::memcpy(m_buffer + offset, src, size);
+        m_ready_frames.store(i + 1, std::memory_order_release);
+    }
+    printf("ClipCache: %s: %zu of %zu frames cached\n",
+           image->label(), i, frame_count);
+}
@@ -0,0 +1,81 @@
+// This file's header
+#include "clip_codec.h"
+
+// C++ standard headers
+#include <cassert>
+#include <cstring>
+
+// Keep this file free of ESP-IDF dependencies.  The host-side tests
+// and benchmarks build it too.
+
+size_t rle_decode(void *dest, size_t pixel_count, const uint8_t *src)
+{
+    uint16_t *out = (uint16_t *)dest;
+    uint16_t *end = out + pixel_count;
+    const uint8_t *in = src;
+
+    while (out < end) {
+        uint8_t header = *in++;
+        size_t count = (header & ~RLE_RUN_BIT) + 1;
+        assert(count <= (size_t)(end - out));
+        if (header & RLE_RUN_BIT) {
+            uint16_t pixel;
+            std::memcpy(&pixel, in, sizeof pixel);
+            in += sizeof pixel;
+
+            // Align to a word boundary, then store two pixels at a time.
+            if (((uintptr_t)out & 2) && count) {
+                *out++ = pixel;
+                --count;
+            }
+            uint32_t pair = (uint32_t)pixel << 16 | pixel;
+            uint32_t *out32 = (uint32_t *)out;
+            for (size_t i = 0; i < count / 2; i++) {
+                *out32++ = pair;
+            }
+            out = (uint16_t *)out32;
+            if (count & 1) {
+                *out++ = pixel;
+            }
+        } else {
+            size_t byte_count = count * sizeof *out;
+            std::memcpy(out, in, byte_count);
+            in += byte_count;
+            out += count;
+        }
+    }
+    return in - src;
+}
+
+size_t rle_skip(size_t pixel_count, const uint8_t *src)
+{
+    const uint8_t *in = src;
+    while (pixel_count) {
+        uint8_t header = *in++;
+        size_t count = (header & ~RLE_RUN_BIT) + 1;
+        assert(count <= pixel_count);
+        pixel_count -= count;
+        in += sizeof (uint16_t) * (header & RLE_RUN_BIT ? 1 : count);
+    }
+    return in - src;
+}
+
+size_t rle_check(size_t pixel_count, const uint8_t *src, size_t src_size)
+{
+    const uint8_t *in = src;
+    const uint8_t *end = src + src_size;
+    while (pixel_count) {
+        if (in == end) {
+            return 0;
+        }
+        uint8_t header = *in++;
+        size_t count = (header & ~RLE_RUN_BIT) + 1;
+        size_t bytes = sizeof (uint16_t) * (header & RLE_RUN_BIT ? 1 : count);
+        if (count > pixel_count || bytes > (size_t)(end - in)) {
+            return 0;
+        }
+        pixel_count -= count;
+        in += bytes;
+    }
+    return in - src;
+}
@@ -0,0 +1,365 @@
+// This file's header
+#include "crossfade.h"
+
+// C++ standard headers
+#include <cassert>
+#include <cstdint>
+
+// Component headers
+#include "dsp_memcpy.h"
+
+#ifdef ESP_PLATFORM
+    #include "sdkconfig.h"
+#endif
+
+static inline uint16_t load_565(const uint8_t *p, PixelEndian endian)
+{
+    if (endian == PixelEndian::BIG) {
+        return p[0] << 8 | p[1];
+    }
+    return p[1] << 8 | p[0];
+}
+
+static inline void store_565(uint8_t *p, uint16_t c, PixelEndian endian)
+{
+    if (endian == PixelEndian::BIG) {
+        p[0] = c >> 8;
+        p[1] = c;
+    } else {
+        p[0] = c;
+        p[1] = c >> 8;
+    }
+}
+
+// Right shifts of negative numbers round down, like the PIE's
+// EE.VMUL.S16.
+static inline int blend_channel(int a, int b, int weight)
+{
+    return a + ((b - a) * weight >> CROSSFADE_WEIGHT_BITS);
+}
+
+void crossfade_565_reference(void *dest,
+                             const void *a,
+                             const void *b,
+                             size_t pixel_count,
+                             unsigned weight,
+                             PixelEndian endian)
+{
+    assert(weight <= CROSSFADE_WEIGHT_MAX);
+    auto *d = (uint8_t *)dest;
+    auto *pa = (const uint8_t *)a;
+    auto *pb = (const uint8_t *)b;
+    for (size_t i = 0; i < pixel_count; i++) {
+        uint16_t ca = load_565(pa + 2 * i, endian);
+        uint16_t cb = load_565(pb + 2 * i, endian);
+        int hi = blend_channel(ca >> 11, cb >> 11, weight);
+        int mid = blend_channel(ca >> 5 & 0x3F, cb >> 5 & 0x3F, weight);
+        int lo = blend_channel(ca & 0x1F, cb & 0x1F, weight);
+        store_565(d + 2 * i, hi << 11 | mid << 5 | lo, endian);
+    }
+}
+
+static inline int add_channel(int a, int b, int weight, int max)
+{
+    int sum = a + (b * weight >> CROSSFADE_WEIGHT_BITS);
+    return sum < max ? sum : max;
+}
+
+void add_565_reference(void *dest,
+                       const void *a,
+                       const void *b,
+                       size_t pixel_count,
+                       unsigned weight,
+                       PixelEndian endian)
+{
+    assert(weight <= CROSSFADE_WEIGHT_MAX);
+    auto *d = (uint8_t *)dest;
+    auto *pa = (const uint8_t *)a;
+    auto *pb = (const uint8_t *)b;
+    for (size_t i = 0; i < pixel_count; i++) {
+        uint16_t ca = load_565(pa + 2 * i, endian);
+        uint16_t cb = load_565(pb + 2 * i, endian);
+        int hi = add_channel(ca >> 11, cb >> 11, weight, 0x1F);
+        int mid = add_channel(ca >> 5 & 0x3F, cb >> 5 & 0x3F, weight, 0x3F);
+        int lo = add_channel(ca & 0x1F, cb & 0x1F, weight, 0x1F);
+        store_565(d + 2 * i, hi << 11 | mid << 5 | lo, endian);
+    }
+}
+
+#if CONFIG_IDF_TARGET_ESP32S3
+
+// Eight pixels per loop, in 16 bit lanes.  PIE only shifts 32 bit
+// lanes, so every shift is followed by a mask.
+//
+//   q5, q6, q7     0x001F, 0x003F, weight in every lane
+//   q4             0x00FF for byte swapping, then the result
+//   q0, q1         a and b, byte swapped to little endian
+//   q2, q3         scratch
+static void
+__attribute__((noinline))
+asm_crossfade_be(void *dest,
+                 const void *a,
+                 const void *b,
+                 size_t chunk_count,
+                 const uint16_t *constants)
+{
+    uint32_t tmp;
+
+    asm volatile (
+
+        "    ee.vldbc.16.ip q5, %[k], 2      \n"
+        "    ee.vldbc.16.ip q6, %[k], 2      \n"
+        "    ee.vldbc.16.ip q7, %[k], 2      \n"
+
+        "loop%=:                             \n"
+        "    ee.vld.128.ip q0, %[a], 16      \n"
+        "    ee.vld.128.ip q1, %[b], 16      \n"
+        "    ee.vldbc.16 q4, %[k]            \n"
+
+        // Byte swap a and b.
+        "    movi %[t], 8                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsr.32 q2, q0                \n"
+        "    ee.andq q2, q2, q4              \n"
+        "    ee.vsl.32 q3, q0                \n"
+        "    ee.andq q0, q3, q4              \n"
+        "    ee.xorq q3, q3, q0              \n"
+        "    ee.orq q0, q2, q3               \n"
+        "    ee.vsr.32 q2, q1                \n"
+        "    ee.andq q2, q2, q4              \n"
+        "    ee.vsl.32 q3, q1                \n"
+        "    ee.andq q1, q3, q4              \n"
+        "    ee.xorq q3, q3, q1              \n"
+        "    ee.orq q1, q2, q3               \n"
+
+        // Low 5 bits.  Result goes in q4.
+        "    movi %[t], 5                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.andq q2, q0, q5              \n"
+        "    ee.andq q3, q1, q5              \n"
+        "    ee.vsubs.s16 q3, q3, q2         \n"
+        "    ee.vmul.s16 q3, q3, q7          \n"
+        "    ee.vadds.s16 q4, q2, q3         \n"
+
+        // Middle 6 bits.  SAR is still 5.
+        "    ee.vsr.32 q2, q0                \n"
+        "    ee.andq q2, q2, q6              \n"
+        "    ee.vsr.32 q3, q1                \n"
+        "    ee.andq q3, q3, q6              \n"
+        "    ee.vsubs.s16 q3, q3, q2         \n"
+        "    ee.vmul.s16 q3, q3, q7          \n"
+        "    ee.vadds.s16 q2, q2, q3         \n"
+        "    ee.vsl.32 q2, q2                \n"
+        "    ee.orq q4, q4, q2               \n"
+
+        // High 5 bits.
+        "    movi %[t], 11                   \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsr.32 q2, q0                \n"
+        "    ee.andq q2, q2, q5              \n"
+        "    ee.vsr.32 q3, q1                \n"
+        "    ee.andq q3, q3, q5              \n"
+        "    ee.vsubs.s16 q3, q3, q2         \n"
+        "    movi %[t], 5                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vmul.s16 q3, q3, q7          \n"
+        "    ee.vadds.s16 q2, q2, q3         \n"
+        "    movi %[t], 11                   \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsl.32 q2, q2                \n"
+        "    ee.orq q4, q4, q2               \n"
+
+        // Swap the result back to big endian.
+        "    ee.vldbc.16 q0, %[k]            \n"
+        "    movi %[t], 8                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsr.32 q2, q4                \n"
+        "    ee.andq q2, q2, q0              \n"
+        "    ee.vsl.32 q3, q4                \n"
+        "    ee.andq q1, q3, q0              \n"
+        "    ee.xorq q3, q3, q1              \n"
+        "    ee.orq q4, q2, q3               \n"
+        "    ee.vst.128.ip q4, %[d], 16      \n"
+
+        "    addi.n %[n], %[n], -1           \n"
+        "    bnez %[n], loop%=                 "
+
+        : [d] "+r" (dest),
+          [a] "+r" (a),
+          [b] "+r" (b),
+          [n] "+r" (chunk_count),
+          [k] "+r" (constants),
+          [t] "=&r" (tmp)
+
+        :
+
+        : "memory"
+    );
+}
+
+// Same register use and byte swapping as asm_crossfade_be().  Each
+// channel is scaled, added with EE.VADDS.S16 and clamped to its
+// mask with EE.VMIN.S16.
+static void
+__attribute__((noinline))
+asm_add_be(void *dest,
+           const void *a,
+           const void *b,
+           size_t chunk_count,
+           const uint16_t *constants)
+{
+    uint32_t tmp;
+
+    asm volatile (
+
+        "    ee.vldbc.16.ip q5, %[k], 2      \n"
+        "    ee.vldbc.16.ip q6, %[k], 2      \n"
+        "    ee.vldbc.16.ip q7, %[k], 2      \n"
+
+        "loop%=:                             \n"
+        "    ee.vld.128.ip q0, %[a], 16      \n"
+        "    ee.vld.128.ip q1, %[b], 16      \n"
+        "    ee.vldbc.16 q4, %[k]            \n"
+
+        // Byte swap a and b.
+        "    movi %[t], 8                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsr.32 q2, q0                \n"
+        "    ee.andq q2, q2, q4              \n"
+        "    ee.vsl.32 q3, q0                \n"
+        "    ee.andq q0, q3, q4              \n"
+        "    ee.xorq q3, q3, q0              \n"
+        "    ee.orq q0, q2, q3               \n"
+        "    ee.vsr.32 q2, q1                \n"
+        "    ee.andq q2, q2, q4              \n"
+        "    ee.vsl.32 q3, q1                \n"
+        "    ee.andq q1, q3, q4              \n"
+        "    ee.xorq q3, q3, q1              \n"
+        "    ee.orq q1, q2, q3               \n"
+
+        // Low 5 bits.  Result goes in q4.
+        "    movi %[t], 5                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.andq q2, q0, q5              \n"
+        "    ee.andq q3, q1, q5              \n"
+        "    ee.vmul.s16 q3, q3, q7          \n"
+        "    ee.vadds.s16 q3, q2, q3         \n"
+        "    ee.vmin.s16 q4, q3, q5          \n"
+
+        // Middle 6 bits.  SAR is still 5.
+        "    ee.vsr.32 q2, q0                \n"
+        "    ee.andq q2, q2, q6              \n"
+        "    ee.vsr.32 q3, q1                \n"
+        "    ee.andq q3, q3, q6              \n"
+        "    ee.vmul.s16 q3, q3, q7          \n"
+        "    ee.vadds.s16 q2, q2, q3         \n"
+        "    ee.vmin.s16 q2, q2, q6          \n"
+        "    ee.vsl.32 q2, q2                \n"
+        "    ee.orq q4, q4, q2               \n"
+
+        // High 5 bits.
+        "    movi %[t], 11                   \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsr.32 q2, q0                \n"
+        "    ee.andq q2, q2, q5              \n"
+        "    ee.vsr.32 q3, q1                \n"
+        "    ee.andq q3, q3, q5              \n"
+        "    movi %[t], 5                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vmul.s16 q3, q3, q7          \n"
+        "    ee.vadds.s16 q2, q2, q3         \n"
+        "    ee.vmin.s16 q2, q2, q5          \n"
+        "    movi %[t], 11                   \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsl.32 q2, q2                \n"
+        "    ee.orq q4, q4, q2               \n"
+
+        // Swap the result back to big endian.
+        "    ee.vldbc.16 q0, %[k]            \n"
+        "    movi %[t], 8                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsr.32 q2, q4                \n"
+        "    ee.andq q2, q2, q0              \n"
+        "    ee.vsl.32 q3, q4                \n"
+        "    ee.andq q1, q3, q0              \n"
+        "    ee.xorq q3, q3, q1              \n"
+        "    ee.orq q4, q2, q3               \n"
+        "    ee.vst.128.ip q4, %[d], 16      \n"
+
+        "    addi.n %[n], %[n], -1           \n"
+        "    bnez %[n], loop%=                 "
+
+        : [d] "+r" (dest),
+          [a] "+r" (a),
+          [b] "+r" (b),
+          [n] "+r" (chunk_count),
+          [k] "+r" (constants),
+          [t] "=&r" (tmp)
+
+        :
+
+        : "memory"
+    );
+}
+
+#endif /* CONFIG_IDF_TARGET_ESP32S3 */
+
+void crossfade_565(void *dest,
+                   const void *a,
+                   const void *b,
+                   size_t pixel_count,
+                   unsigned weight,
+                   PixelEndian endian)
+{
+    const size_t DSP_ALIGN_MASK = DSP_ALIGNMENT - 1;
+
+    assert(weight <= CROSSFADE_WEIGHT_MAX);
+    assert(((intptr_t)dest & DSP_ALIGN_MASK) == 0);
+    assert(((intptr_t)a & DSP_ALIGN_MASK) == 0);
+    assert(((intptr_t)b & DSP_ALIGN_MASK) == 0);
+    assert(pixel_count % CROSSFADE_PIXEL_MULTIPLE == 0);
+
+#if CONFIG_IDF_TARGET_ESP32S3
+    if (endian == PixelEndian::BIG && pixel_count) {
+        // Masks and weight, in the order the kernel loads them.
+        const uint16_t constants[4] DSP_ALIGNED_ATTR = {
+            0x001F, 0x003F, (uint16_t)weight, 0x00FF,
+        };
+        size_t chunk_count = pixel_count / CROSSFADE_PIXEL_MULTIPLE;
+        asm_crossfade_be(dest, a, b, chunk_count, constants);
+        return;
+    }
+#endif
+
+    crossfade_565_reference(dest, a, b, pixel_count, weight, endian);
+}
+
+void add_565(void *dest,
+             const void *a,
+             const void *b,
+             size_t pixel_count,
+             unsigned weight,
+             PixelEndian endian)
+{
+    const size_t DSP_ALIGN_MASK = DSP_ALIGNMENT - 1;
+
+    assert(weight <= CROSSFADE_WEIGHT_MAX);
+    assert(((intptr_t)dest & DSP_ALIGN_MASK) == 0);
+    assert(((intptr_t)a & DSP_ALIGN_MASK) == 0);
+    assert(((intptr_t)b & DSP_ALIGN_MASK) == 0);
+    assert(pixel_count % CROSSFADE_PIXEL_MULTIPLE == 0);
+
+#if CONFIG_IDF_TARGET_ESP32S3
+    if (endian == PixelEndian::BIG && pixel_count) {
+        // Masks and weight, in the order the kernel loads them.
+        const uint16_t constants[4] DSP_ALIGNED_ATTR = {
+            0x001F, 0x003F, (uint16_t)weight, 0x00FF,
+        };
+        size_t chunk_count = pixel_count / CROSSFADE_PIXEL_MULTIPLE;
+        asm_add_be(dest, a, b, chunk_count, constants);
+        return;
+    }
+#endif
+
+    add_565_reference(dest, a, b, pixel_count, weight, endian);
+}
@@ -104,7 +104,7 @@ bool DisplayController::execute_init_string(InitOps& ops) const
     #define CHECK(b) ({ if (!(b)) goto check_failed; })
     #define NEXT() (CHECK(cursor < end), *cursor++)
     #define SKIP(n) \
-        ({size_t n_ = (n); CHECK(n_ <= end - cursor), cursor += n_; })
+        ({size_t n_ = (n); CHECK(n_ <= (size_t)(end - cursor)), cursor += n_; })
 
     {
         // Create a block scope so goto won't break lifetimes
@@ -2,6 +2,7 @@
 #include "driver_battery.h"
 
 // C++ standard headers
+#include <cassert>
 #include <cstdio>
 
 // ESP-IDF headers
@@ -123,9 +124,10 @@ struct BatteryDriver_private {
     }
 
 private:
+    // The host build's stand-in ADC has the ESP32-S3's pins.
     static adc_unit_t gpio_to_unit(gpio_num_t gpio)
     {
-#ifdef CONFIG_IDF_TARGET_ESP32S3
+#if defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_LINUX)
         switch (gpio) {
 
         case GPIO_NUM_1:
@@ -159,7 +161,7 @@ private:
 
     static adc_channel_t gpio_to_channel(gpio_num_t gpio)
     {
-#ifdef CONFIG_IDF_TARGET_ESP32S3
+#if defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_LINUX)
         switch (gpio) {
 
         case GPIO_NUM_1:
@@ -223,7 +225,7 @@ private:
 
     static int gpio_to_bit_width(gpio_num_t)
     {
-#ifdef CONFIG_IDF_TARGET_ESP32S3
+#if defined(CONFIG_IDF_TARGET_ESP32S3) || defined(CONFIG_IDF_TARGET_LINUX)
         return 12;
 #else
         #error "gpio_to_bit_width: unknown target"
@@ -1,12 +1,19 @@
 // This file's header
 #include "driver_display.h"
 
+// C++ standard headers
+#include <cassert>
+#include <cinttypes>
+#include <cstring>
+
 // ESP-IDF headers
+#include "esp_attr.h"
 #include "esp_err.h"
 #include "freertos/FreeRTOS.h"
 
 // Component headers
 #include "board_defs.h"         // for UNDEFINED_GPIO
+#include "trace.h"
 
 enum {
     SPI_COMMAND_MODE = 0,
@@ -15,14 +22,23 @@ enum {
 
 bool spi_verbose = false;
 
+// The SPI callbacks only get a transaction, so they find the driver
+// here.  There's one display.
+static SPIDisplayDriver *s_driver;
+
 
 // //  //   //    //     //      //       //      //     //    //   //  // //
 // Initialization
 
 SPIDisplayDriver::SPIDisplayDriver(SPIDisplayDesc& desc)
 : m_desc(desc),
-  m_device_handle(0)
+  m_device_handle(0),
+  m_window_trans{},
+  m_window_busy{},
+  m_window_rotor(0)
 {
+    assert(s_driver == nullptr);
+    s_driver = this;
     init();
 }
 
@@ -44,6 +60,7 @@ SPIDisplayDriver::~SPIDisplayDriver()
     }
     ESP_ERROR_CHECK(gpio_reset_pin(m_desc.dc_gpio));
     ESP_ERROR_CHECK(gpio_reset_pin(m_desc.cs_gpio));
+    s_driver = nullptr;
 }
 
 void SPIDisplayDriver::init()
@@ -83,6 +100,7 @@ void SPIDisplayDriver::init_SPI_peripheral()
     bus_config.sclk_io_num = m_desc.sclk_gpio;
     bus_config.quadwp_io_num = -1;
     bus_config.quadhd_io_num = -1;
+    bus_config.max_transfer_sz = m_desc.max_transaction_bytes;
 
     ESP_ERROR_CHECK(
         spi_bus_initialize(m_desc.spi_host, &bus_config, SPI_DMA_CH_AUTO)
@@ -94,7 +112,12 @@ void SPIDisplayDriver::init_SPI_peripheral()
     dev_config.clock_speed_hz = m_desc.spi_clock_speed;
     dev_config.spics_io_num = (int)m_desc.cs_gpio;
     dev_config.flags = SPI_DEVICE_NO_DUMMY;
-    dev_config.queue_size = 7;  // tunable
+    // Room for every pixel and window transaction in flight, and
+    // the polled ones write_bytes() sends.
+    dev_config.queue_size =
+        m_desc.queue_size + WINDOW_SLOTS * WINDOW_STEPS + 1;
+    dev_config.pre_cb = pre_cb;
+    dev_config.post_cb = post_cb;
 
     spi_device_handle_t dev_handle;
     ESP_ERROR_CHECK(
@@ -105,6 +128,8 @@ void SPIDisplayDriver::init_SPI_peripheral()
     ESP_ERROR_CHECK(
         spi_bus_get_max_transaction_len(m_desc.spi_host, &max_bytes)
     );
+    assert(max_bytes >= m_desc.max_transaction_bytes);
+    (void)max_bytes;
 
     m_device_handle = dev_handle;
 }
@@ -152,17 +177,6 @@ void SPIDisplayDriver::delay_msec(uint32_t ms)
     vTaskDelay(ticks);
 }
 
-void SPIDisplayDriver::write_address(uint16_t addr1, uint16_t addr2)
-{
-    static uint8_t bytes[4];
-    bytes[0] = (uint8_t)(addr1 >> 8);
-    bytes[1] = (uint8_t)addr1;
-    bytes[2] = (uint8_t)(addr2 >> 8);
-    bytes[3] = (uint8_t)addr2;
-
-    write_data(bytes, sizeof bytes);
-}
-
 void SPIDisplayDriver::write_bytes(const uint8_t *bytes, size_t count)
 {
     if (spi_verbose) {
@@ -180,7 +194,52 @@ void SPIDisplayDriver::write_bytes(const uint8_t *bytes, size_t count)
     );
 }
 
-void SPIDisplayDriver::send_start_write_command(
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// DMA Interface
+
+// Which window transaction this is, or past the end if it isn't one.
+static inline IRAM_ATTR size_t window_index(const spi_transaction_t *trans,
+                                            const spi_transaction_t *first)
+{
+    return ((uintptr_t)trans - (uintptr_t)first) / sizeof *trans;
+}
+
+// Steps 0, 2 and 4 of a window are command bytes; 1 and 3 are
+// their parameters.
+void IRAM_ATTR SPIDisplayDriver::pre_cb(spi_transaction_t *trans)
+{
+    SPIDisplayDriver *self = s_driver;
+    size_t index = window_index(trans, &self->m_window_trans[0][0]);
+    if (index < WINDOW_SLOTS * WINDOW_STEPS) {
+        bool is_param = index % WINDOW_STEPS % 2;
+        gpio_set_level(self->m_desc.dc_gpio,
+                       is_param ? SPI_DATA_MODE : SPI_COMMAND_MODE);
+    } else if (trans->user) {
+        gpio_set_level(self->m_desc.dc_gpio, SPI_DATA_MODE);
+    }
+    // Polled transactions set DC themselves.
+}
+
+void IRAM_ATTR SPIDisplayDriver::post_cb(spi_transaction_t *trans)
+{
+    SPIDisplayDriver *self = s_driver;
+    size_t index = window_index(trans, &self->m_window_trans[0][0]);
+    if (index < WINDOW_SLOTS * WINDOW_STEPS) {
+        if (index % WINDOW_STEPS == WINDOW_STEPS - 1) {
+            self->m_window_busy[index / WINDOW_STEPS].store(
+                false, std::memory_order_release);
+        }
+    } else if (trans->user && self->m_desc.post_cb) {
+        (*self->m_desc.post_cb)(trans);
+    }
+}
+
+bool SPIDisplayDriver::window_slot_free() const
+{
+    return !m_window_busy[m_window_rotor].load(std::memory_order_acquire);
+}
+
+void SPIDisplayDriver::enqueue_start_write_command(
     uint16_t x0, uint16_t y0,
     uint16_t x1, uint16_t y1)
 {
@@ -190,32 +249,46 @@ void SPIDisplayDriver::send_start_write_command(
     y0 += ctlr.RASET_y0_adjust;
     y1 += ctlr.RASET_y1_adjust;
 
-    gpio_set_level(m_desc.dc_gpio, SPI_COMMAND_MODE);
-
-    // spi_verbose = true;
-    write_command(CASET);
-    write_address(x0, x1);
-    write_command(PASET);
-    write_address(y0, y1);
-    write_command(RAMWR);
-    // spi_verbose = false;
-
-    gpio_set_level(m_desc.dc_gpio, SPI_DATA_MODE);
+    size_t slot = m_window_rotor;
+    m_window_rotor = (m_window_rotor + 1) % WINDOW_SLOTS;
+    while (m_window_busy[slot].load(std::memory_order_acquire)) {
+        (void)await_transaction();
+    }
+    m_window_busy[slot].store(true, std::memory_order_relaxed);
+
+    // Short enough to go in the transactions themselves.
+    const uint8_t bytes[WINDOW_STEPS][4] = {
+        { CASET },
+        { (uint8_t)(x0 >> 8), (uint8_t)x0, (uint8_t)(x1 >> 8), (uint8_t)x1 },
+        { PASET },
+        { (uint8_t)(y0 >> 8), (uint8_t)y0, (uint8_t)(y1 >> 8), (uint8_t)y1 },
+        { RAMWR },
+    };
+    for (size_t step = 0; step < WINDOW_STEPS; step++) {
+        spi_transaction_t *trans = &m_window_trans[slot][step];
+        *trans = {};
+        trans->flags = SPI_TRANS_USE_TXDATA;
+        trans->length = (step % 2 ? 4 : 1) * 8;
+        std::memcpy(trans->tx_data, bytes[step], sizeof trans->tx_data);
+        enqueue_transaction(trans);
+    }
 }
 
-
-// //  //   //    //     //      //       //      //     //    //   //  // //
-// DMA Interface
-
 void SPIDisplayDriver::enqueue_transaction(spi_transaction_t *trans)
 {
+    // Collect finished results first so the driver's queue has room.
+    while (reap_transaction()) {
+        continue;
+    }
+
     // const uint8_t *tb = (const uint8_t *)trans_desc->tx_buffer;
     // printf("enqueue_transaction: %u bytes @ %p [%x %x %x %x...]\n",
     //     trans_desc->length, tb, tb[0], tb[1], tb[2], tb[3]);
-    if (trans->length > SPI_MAX_DMA_LEN * CHAR_BIT) {
+    size_t max_bits = m_desc.max_transaction_bytes * CHAR_BIT;
+    if (trans->length > max_bits) {
         printf("transaction is %zu bytes\n", trans->length / CHAR_BIT);
     }
-    assert(trans->length <= SPI_MAX_DMA_LEN * CHAR_BIT);
+    assert(trans->length <= max_bits);
     TickType_t ticks_to_wait = pdMS_TO_TICKS(1000);
     ESP_ERROR_CHECK(
         spi_device_queue_trans(m_device_handle, trans, ticks_to_wait)
@@ -224,6 +297,7 @@ void SPIDisplayDriver::enqueue_transaction(spi_transaction_t *trans)
 
 spi_transaction_t *SPIDisplayDriver::await_transaction()
 {
+    Trace::Span span(TRACE_SPI_WAIT, 1);
     spi_transaction_t *trans = nullptr;
     TickType_t ticks_to_wait = pdMS_TO_TICKS(1000);
     ESP_ERROR_CHECK(
@@ -231,3 +305,15 @@ spi_transaction_t *SPIDisplayDriver::await_transaction()
     );
     return trans;
 }
+
+spi_transaction_t *SPIDisplayDriver::reap_transaction()
+{
+    spi_transaction_t *trans = nullptr;
+    esp_err_t err =
+        spi_device_get_trans_result(m_device_handle, &trans, 0);
+    if (err == ESP_ERR_TIMEOUT) {
+        return nullptr;
+    }
+    ESP_ERROR_CHECK(err);
+    return trans;
+}
@@ -4,6 +4,13 @@
 // C++ standard headers
 #include <cassert>
 #include <cstdint>
+#include <cstring>
+
+#ifdef ESP_PLATFORM
+    #include "sdkconfig.h"
+#endif
+
+#if CONFIG_IDF_TARGET_ESP32S3
 
 static void
 __attribute__((noinline))
@@ -50,6 +57,8 @@ asm_copy_chunks(void *dest, const void *src, size_t chunk_count)
     );
 }
 
+#endif /* CONFIG_IDF_TARGET_ESP32S3 */
+
 void *dsp_memcpy(void *dest, const void *src, size_t size)
 {
     const size_t REG_BYTES = 16;
@@ -62,7 +71,11 @@ void *dsp_memcpy(void *dest, const void *src, size_t size)
     assert(((intptr_t)src & DSP_ALIGN_MASK) == 0);
     assert((size & BAD_SIZE_MASK) == 0);
 
+#if CONFIG_IDF_TARGET_ESP32S3
     size_t chunk_count = size / CHUNK_BYTES;
     asm_copy_chunks(dest, src, chunk_count);
     return dest;
+#else
+    return memcpy(dest, src, size);
+#endif
 }
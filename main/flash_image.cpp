@@ -2,14 +2,18 @@
 #include "flash_image.h"
 
 // C++ standard headers
+#include <cinttypes>
+#include <cstdarg>
+#include <cstdio>
 #include <cstring>
 
 // ESP-IDF headers
 #include "esp_check.h"
 #include "esp_partition.h"
 
-FlashImage FlashImage::images[FlashImage::MAX_IMAGES];
+FlashImage *FlashImage::images;
 size_t FlashImage::image_count;
+bool FlashImage::images_found;
 
 FlashImage::~FlashImage()
 {
@@ -17,9 +21,101 @@ FlashImage::~FlashImage()
     m_label[0] = '\0';
 }
 
+void FlashImage::read_frame(size_t i,
+                            image_type *dest,
+                            const uint8_t *data) const
+{
+    if (!data) {
+        data = frame_data(i);
+    }
+    switch (m_codec) {
+
+    case ClipCodec::RAW:
+        std::memcpy((void *)dest, data, FRAME_SIZE);
+        break;
+
+    case ClipCodec::RLE:
+        {
+            size_t used = rle_decode(dest, FRAME_PIXEL_COUNT, data);
+            assert(used == frame_data_size(i));
+            (void)used;
+        }
+        break;
+
+    case ClipCodec::DELTA:
+        {
+            const uint8_t *src = data;
+            StripeMask mask = frame_stripe_mask(i);
+            src += sizeof mask;
+            for (size_t stripe = 0; stripe < STRIPE_COUNT; stripe++) {
+                if (mask & stripe_bit(stripe)) {
+                    pixel_type *rows = (*dest)[stripe * STRIPE_HEIGHT];
+                    src += rle_decode(rows, STRIPE_PIXEL_COUNT, src);
+                }
+            }
+            assert(src == data + frame_data_size(i));
+        }
+        break;
+    }
+}
+
+void FlashImage::locate_stripes(size_t i,
+                                const uint8_t **stripe_data,
+                                const uint8_t *data) const
+{
+    if (!data) {
+        data = frame_data(i);
+    }
+    const uint8_t *src = data;
+    StripeMask mask = frame_stripe_mask(i);
+    if (m_codec == ClipCodec::DELTA) {
+        src += sizeof mask;
+    }
+    for (size_t stripe = 0; stripe < STRIPE_COUNT; stripe++) {
+        if (mask & stripe_bit(stripe)) {
+            stripe_data[stripe] = src;
+            if (m_codec == ClipCodec::RAW) {
+                src += STRIPE_PIXEL_COUNT * sizeof (pixel_type);
+            } else {
+                src += rle_skip(STRIPE_PIXEL_COUNT, src);
+            }
+        }
+    }
+    assert(src == data + frame_data_size(i));
+}
+
+void FlashImage::read_stripe(const uint8_t *stripe_data, pixel_type *dest) const
+{
+    if (m_codec == ClipCodec::RAW) {
+        size_t size = STRIPE_PIXEL_COUNT * sizeof (pixel_type);
+        std::memcpy((void *)dest, stripe_data, size);
+    } else {
+        (void)rle_decode(dest, STRIPE_PIXEL_COUNT, stripe_data);
+    }
+}
+
+StripeMask FlashImage::frame_stripe_mask(size_t i) const
+{
+    if (m_codec != ClipCodec::DELTA) {
+        return all_stripes(STRIPE_COUNT);
+    }
+    StripeMask mask;
+    std::memcpy(&mask, frame_data(i), sizeof mask);
+    return mask;
+}
+
+size_t FlashImage::keyframe_at_or_before(size_t i) const
+{
+    assert(i < m_frame_count);
+    while (i > 0 && !is_keyframe(i)) {
+        --i;
+    }
+    return i;
+}
+
 FlashImage *FlashImage::get_by_label(const char *label)
 {
-    if (image_count == 0) {
+    if (!images_found) {
         find_images();
     }
     for (size_t i = 0; i < image_count; i++) {
@@ -31,9 +127,17 @@ FlashImage *FlashImage::get_by_label(const char *label)
     return nullptr;
 }
 
+size_t FlashImage::count()
+{
+    if (!images_found) {
+        find_images();
+    }
+    return image_count;
+}
+
 FlashImage *FlashImage::get_by_index(size_t index)
 {
-    if (image_count == 0) {
+    if (!images_found) {
         find_images();
     }
     if (index >= image_count) {
@@ -50,9 +154,19 @@ void FlashImage::find_images()
     auto type = ESP_PARTITION_TYPE_DATA;
     auto subtype = (esp_partition_subtype_t) 0x40;
     auto label = nullptr;
+
+    // Count them first so the table is allocated once.
+    size_t partition_count = 0;
     auto iter = esp_partition_find(type, subtype, label);
+    for (auto it = iter; it; it = esp_partition_next(it)) {
+        partition_count++;
+    }
+    images = new FlashImage[partition_count];
+    images_found = true;
+
+    iter = esp_partition_find(type, subtype, label);
     image_count = 0;
-    for (size_t i = 0; iter && i < MAX_IMAGES; i++) {
+    while (iter) {
 
         // find a partition
         auto *part = esp_partition_get(iter);
@@ -69,15 +183,163 @@ void FlashImage::find_images()
             esp_partition_mmap(part, 0, part->size, memory, &ptr, &handle)
         );
 
-        FlashImage *image = &images[i];
+        FlashImage *image = &images[image_count];
         strncpy(image->m_label, part->label, MAX_LABEL_SIZE);
         image->m_label[MAX_LABEL_SIZE] = '\0';
         image->m_addr = ptr;
         image->m_size = part->size;
         image->m_handle = handle;
+        if (!image->parse_header()) {
+            esp_partition_munmap(handle);
+            continue;
+        }
         image_count++;
     }
 
     esp_partition_iterator_release(iter);
 }
 
+static bool reject(const char *label, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    printf("FlashImage: %s: rejected: ", label);
+    vprintf(fmt, args);
+    printf("\n");
+    va_end(args);
+    return false;
+}
+
+// Walk one compressed frame's packets without trusting them.
+// Returns what's wrong, or nullptr.
+static const char *check_frame_data(ClipCodec codec,
+                                    const uint8_t *data,
+                                    size_t size,
+                                    bool keyframe)
+{
+    const size_t STRIPE_COUNT = FlashImage::STRIPE_COUNT;
+    StripeMask mask = all_stripes(STRIPE_COUNT);
+    size_t used = 0;
+    if (codec == ClipCodec::DELTA) {
+        if (size < sizeof mask) {
+            return "no stripe mask";
+        }
+        std::memcpy(&mask, data, sizeof mask);
+        used = sizeof mask;
+        if (mask & ~all_stripes(STRIPE_COUNT)) {
+            return "stripe mask has stripes past the image";
+        }
+        if (keyframe && mask != all_stripes(STRIPE_COUNT)) {
+            return "keyframe is missing stripes";
+        }
+    }
+    for (size_t stripe = 0; stripe < STRIPE_COUNT; stripe++) {
+        if (mask & stripe_bit(stripe)) {
+            size_t n = rle_check(FlashImage::STRIPE_PIXEL_COUNT,
+                                 data + used,
+                                 size - used);
+            if (n == 0) {
+                return "bad RLE data";
+            }
+            used += n;
+        }
+    }
+    if (used != size) {
+        return "size doesn't match its data";
+    }
+    return nullptr;
+}
+
+// Check the clip header against this build.  Print what's wrong
+// and return false if it doesn't match.
+bool FlashImage::parse_header()
+{
+    const char *codec_names[] = { "raw", "RLE", "DELTA" };
+    const auto *hdr = (const ClipHeader *)m_addr;
+
+    if (m_size < sizeof *hdr) {
+        return reject(m_label, "partition too small");
+    }
+    if (std::memcmp(hdr->magic, CLIP_MAGIC, sizeof CLIP_MAGIC)) {
+        return reject(m_label, "no clip header");
+    }
+    if (hdr->version != CLIP_VERSION) {
+        return reject(m_label, "version %u, expected %u",
+                      hdr->version, CLIP_VERSION);
+    }
+    if (hdr->header_size < sizeof *hdr) {
+        return reject(m_label, "header is %u bytes", hdr->header_size);
+    }
+    if (hdr->width != IMAGE_WIDTH || hdr->height != IMAGE_HEIGHT) {
+        return reject(m_label, "%ux%u, expected %zux%zu",
+                      hdr->width, hdr->height, IMAGE_WIDTH, IMAGE_HEIGHT);
+    }
+    if (hdr->pixel_order != DISPLAY_PIXEL_ORDER ||
+        hdr->pixel_endian != DISPLAY_PIXEL_ENDIAN) {
+        return reject(m_label, "pixel format %#" PRIx32 "/%u, expected %#x/%u",
+                      hdr->pixel_order, hdr->pixel_endian,
+                      DISPLAY_PIXEL_ORDER, DISPLAY_PIXEL_ENDIAN);
+    }
+    if (hdr->codec > (uint8_t)ClipCodec::DELTA) {
+        return reject(m_label, "unknown codec %u", hdr->codec);
+    }
+    if (hdr->codec != (uint8_t)ClipCodec::RAW &&
+        hdr->stripe_height != STRIPE_HEIGHT) {
+        return reject(m_label, "stripe height %u, expected %zu",
+                      hdr->stripe_height, STRIPE_HEIGHT);
+    }
+    if (hdr->frame_count == 0 || hdr->frame_period_usec == 0) {
+        return reject(m_label, "no frames");
+    }
+
+    uint64_t index_end = hdr->index_offset +
+        (uint64_t)hdr->frame_count * sizeof (ClipFrameIndex);
+    if (index_end > m_size) {
+        return reject(m_label, "index overflows partition");
+    }
+    const auto *index =
+        (const ClipFrameIndex *)((const uint8_t *)m_addr + hdr->index_offset);
+    // The decoders trust the index and the frame data, so check
+    // every entry and walk every compressed frame.
+    for (size_t i = 0; i < hdr->frame_count; i++) {
+        const auto& frame = index[i];
+        if ((uint64_t)frame.offset + frame.size > m_size) {
+            return reject(m_label, "frame %zu overflows partition", i);
+        }
+        if (i > 0 && frame.offset < index[i - 1].offset) {
+            return reject(m_label, "frame %zu is out of order", i);
+        }
+        if (hdr->codec == (uint8_t)ClipCodec::RAW &&
+            frame.size != FRAME_SIZE) {
+            return reject(m_label, "raw frame %zu is %" PRIu32 " bytes",
+                          i, frame.size);
+        }
+        if (hdr->codec != (uint8_t)ClipCodec::RAW) {
+            const char *problem = check_frame_data(
+                (ClipCodec)hdr->codec,
+                (const uint8_t *)m_addr + frame.offset,
+                frame.size,
+                frame.flags & CLIP_FRAME_KEYFRAME);
+            if (problem) {
+                return reject(m_label, "frame %zu: %s", i, problem);
+            }
+        }
+    }
+    if (!(index[0].flags & CLIP_FRAME_KEYFRAME)) {
+        return reject(m_label, "first frame is not a keyframe");
+    }
+    const auto& last = index[hdr->frame_count - 1];
+
+    m_codec = (ClipCodec)hdr->codec;
+    m_frame_period_usec = hdr->frame_period_usec;
+    m_frame_count = hdr->frame_count;
+    m_index = index;
+    printf("FlashImage: %s: %zu %s frames, %" PRIu32 " bytes, "
+           "%" PRIu32 " usec/frame\n",
+           m_label,
+           m_frame_count,
+           codec_names[hdr->codec],
+           last.offset + last.size,
+           m_frame_period_usec);
+    return true;
+}
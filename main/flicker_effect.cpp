@@ -2,36 +2,178 @@
 #include "flicker_effect.h"
 
 // C++ standard headers
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <iterator>
 #include <numbers>
 
-// This is the sum of 10 sine waves of various frequencies,
-// rectified.  It ranges from 0 to about 4.5.
-float SpookyFlickerEffect::spooky_flicker_function(unsigned frame) const {
-    assert(frame < m_anim_frame_count);
-
-    static float s_frequencies[HARMONICS];
+// Each wave's frequency, in radians per flicker loop.
+static const float *frequencies()
+{
+    static float s_frequencies[10];
     if (s_frequencies[0] == 0) {
         const float TAU = 2.0 * std::numbers::pi;
-        for (size_t h = 0; h < HARMONICS; h++) {
-            s_frequencies[h] = std::powf(h + 1, 1.5f) * TAU;
+        for (size_t h = 0; h < std::size(s_frequencies); h++) {
+            s_frequencies[h] = std::pow(h + 1.0f, 1.5f) * TAU;
+        }
+    }
+    return s_frequencies;
+}
+
+SpookyFlickerEffect::SpookyFlickerEffect(
+    Backlight& backlight,
+    unsigned anim_frame_count,
+    bool enabled)
+: m_backlight(backlight),
+  m_anim_frame_count(anim_frame_count),
+  m_scale(1.0f),
+  m_enabled(enabled),
+  m_dark_refreshes(0),
+  m_brightness(0.0f)
+{
+    set_animation_frame_count(anim_frame_count);
+}
+
+void SpookyFlickerEffect::set_animation_frame_count(unsigned count)
+{
+    assert(count > 0);
+    m_anim_frame_count = count;
+    const float *freq = frequencies();
+    for (size_t h = 0; h < HARMONICS; h++) {
+        double turn = (double)freq[h] / count;
+        m_turn_re[h] = std::cos(turn);
+        m_turn_im[h] = std::sin(turn);
+    }
+    seek(m_phasors, 0);
+    m_scale = calc_scale();
+    find_dark_runs();
+    m_dark_refreshes = 0;
+}
+
+void SpookyFlickerEffect::update()
+{
+    if (m_enabled) {
+        m_brightness = phasor_function(m_phasors) * m_scale;
+        m_backlight.set_brightness(m_brightness);
+        if (m_dark_refreshes > 1) {
+            m_dark_refreshes--;
+        } else if (m_brightness > 0.0f) {
+            m_dark_refreshes = 0;
+        } else {
+            m_dark_refreshes = dark_frames_from(m_phasors.frame);
         }
     }
+    step(m_phasors);
+}
 
+// This is the sum of 10 sine waves of various frequencies,
+// rectified.  It ranges from 0 to about 4.5.
+float SpookyFlickerEffect::spooky_flicker_function(unsigned frame) const {
+    assert(frame < m_anim_frame_count);
+
+    const float *freq = frequencies();
     float x = (float)frame / (float)m_anim_frame_count;
     float acc = 0.0f;
-    for (int h = 0; h < HARMONICS; h++) {
-        acc += std::sinf(s_frequencies[h] * x);
+    for (size_t h = 0; h < HARMONICS; h++) {
+        acc += std::sin(freq[h] * x);
     }
     acc += 1.0f; // reduce the duty cycle a little
     return std::max(-acc, 0.0f); // dark part first
 }
 
-float SpookyFlickerEffect::calc_scale()
+// spooky_flicker_function(p.frame), give or take rounding.
+float SpookyFlickerEffect::phasor_function(const Phasors& p) const
+{
+    float acc = 0.0f;
+    for (size_t h = 0; h < HARMONICS; h++) {
+        acc += p.im[h];
+    }
+    acc += 1.0f;
+    return std::max(-acc, 0.0f);
+}
+
+void SpookyFlickerEffect::seek(Phasors& p, unsigned frame) const
+{
+    const float *freq = frequencies();
+    float x = (float)frame / (float)m_anim_frame_count;
+    p.frame = frame;
+    for (size_t h = 0; h < HARMONICS; h++) {
+        p.re[h] = std::cos(freq[h] * x);
+        p.im[h] = std::sin(freq[h] * x);
+    }
+}
+
+void SpookyFlickerEffect::step(Phasors& p) const
+{
+    unsigned frame = p.frame + 1;
+    if (frame == m_anim_frame_count) {
+        seek(p, 0);
+        return;
+    }
+    if (frame % RESYNC_FRAMES == 0) {
+        seek(p, frame);
+        return;
+    }
+    p.frame = frame;
+    for (size_t h = 0; h < HARMONICS; h++) {
+        float re = p.re[h] * m_turn_re[h] - p.im[h] * m_turn_im[h];
+        float im = p.re[h] * m_turn_im[h] + p.im[h] * m_turn_re[h];
+        p.re[h] = re;
+        p.im[h] = im;
+    }
+}
+
+float SpookyFlickerEffect::calc_scale() const
 {
+    Phasors p;
+    seek(p, 0);
     float max = 0.0f;
     for (unsigned frame = 0; frame < m_anim_frame_count; frame++) {
-        max = std::max(max, spooky_flicker_function(frame));
+        max = std::max(max, phasor_function(p));
+        step(p);
     }
     return 1.0f / max;
 }
+
+// The phasors are stepped exactly as update() will step them, so the
+// runs agree with the backlight.
+void SpookyFlickerEffect::find_dark_runs()
+{
+    m_dark_runs.clear();
+    Phasors p;
+    seek(p, 0);
+    for (unsigned frame = 0; frame < m_anim_frame_count; frame++) {
+        if (phasor_function(p) <= 0.0f) {
+            if (!m_dark_runs.empty() &&
+                m_dark_runs.back().start + m_dark_runs.back().length == frame) {
+                m_dark_runs.back().length++;
+            } else {
+                m_dark_runs.push_back({frame, 1});
+            }
+        }
+        step(p);
+    }
+    if (m_dark_runs.size() > 1) {
+        DarkRun& first = m_dark_runs.front();
+        DarkRun& last = m_dark_runs.back();
+        if (first.start == 0 &&
+            last.start + last.length == m_anim_frame_count) {
+            last.length += first.length;
+        }
+    }
+}
+
+// How many frames, starting with this one, are dark.
+unsigned SpookyFlickerEffect::dark_frames_from(unsigned frame) const
+{
+    auto run = std::upper_bound(
+        m_dark_runs.begin(), m_dark_runs.end(), frame,
+        [](unsigned f, const DarkRun& r) { return f < r.start; });
+    if (run == m_dark_runs.begin()) {
+        return 0;
+    }
+    --run;
+    unsigned into = frame - run->start;
+    return into < run->length ? run->length - into : 0;
+}
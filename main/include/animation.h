@@ -1,35 +1,205 @@
 // This file's header
 #pragma once
 
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "clip_codec.h"
 #include "pixel_types.h"
+#include "random.h"
+#include "spi_display.h"
+#include "spsc_queue.h"
 
+class ClipCache;
 class FlashImage;
+class Playlist;
 
 class Animation {
 
 public:
-    Animation(unsigned anim_frame_count, float soul_change_probability);
+    // How frames get from flash to the screen.
+    enum FrameLoading {
+        // Load a whole frame in update() when one is due.
+        LOAD_INLINE,
 
+        // Load whole frames ahead of time in a task on the other core.
+        LOAD_IN_TASK,
+
+        // No frame buffers.  Each stripe is decoded from flash when
+        // it is needed.
+        STREAM_STRIPES,
+    };
+
+    // Each clip's frame rate comes from its header.  `refresh_hz`
+    // is how often update() is called.  The playlist may switch
+    // clips every `anim_frame_count` refreshes, dissolving from one
+    // to the other over `dissolve_sec`.  Frames are read through the
+    // cache when it has them.
+    Animation(unsigned anim_frame_count,
+              const Playlist&,
+              ClipCache&,
+              float refresh_hz,
+              FrameLoading,
+              float dissolve_sec);
+    ~Animation();
+
+    bool streams_stripes() const { return m_loading == STREAM_STRIPES; }
+
+    // Only valid if not streaming stripes.
     image_type *current_frame() const;
 
+    // The display may DMA stripes straight out of current_frame().
+    // Report the last transaction that does, and the buffer isn't
+    // loaded again until the display has finished it.
+    void set_display(SPIDisplay *display) { m_display = display; }
+    void set_frame_transaction(TransactionID id)
+    {
+        m_buffer_trans[m_current_image_buffer] = id;
+    }
+
+    // Pixels of the stripe starting at row y.  They point into
+    // current_frame(), or they are decoded into `scratch`, which
+    // must hold SPIDisplay::STRIPE_HEIGHT rows.
+    const pixel_type *stripe(size_t y, pixel_type *scratch) const;
+
+    // frame_serial() increments every time current_frame() changes.
+    // changed_stripes() is what changed that time.
+    unsigned frame_serial() const { return m_frame_serial; }
+    StripeMask changed_stripes() const { return m_changed_stripes; }
+
+    // The frame after current_frame(), if it's loaded yet, and what
+    // it changes.  Only in LOAD_IN_TASK mode; otherwise nullptr.
+    const image_type *next_frame(StripeMask *changed) const;
+
+    // How far the clip has moved from current_frame() toward
+    // next_frame(), 0 to CROSSFADE_WEIGHT_MAX.
+    unsigned fade_weight() const;
+
+    // While the playlist switches clips, the incoming clip dissolves
+    // in over the outgoing one.
+    //
+    // Memory plan: the incoming clip never gets a frame buffer.  It
+    // is located stripe by stripe, like STREAM_STRIPES, straight from
+    // flash.  incoming_stripe() decodes one stripe into `scratch`
+    // (a bounce buffer) just before it's blended.  So a dissolve
+    // costs a table of stripe pointers, not a frame.
+    bool dissolving() const { return m_dissolve_image != nullptr; }
+    unsigned dissolve_weight() const;     // 0 to CROSSFADE_WEIGHT_MAX
+    const pixel_type *incoming_stripe(size_t y, pixel_type *scratch) const;
+
+    // LOAD_IN_TASK statistics.  A late frame is a refresh where the
+    // next frame should have been shown but wasn't loaded yet.
+    unsigned late_frame_count() const { return m_late_frames; }
+    size_t queued_frame_count() const { return m_ready_frames.size(); }
+
+    // While the screen can't be seen, the clip pauses and no frames
+    // are loaded.  A change of clip or a dissolve still runs to the
+    // end, so the screen lights up on the new clip.
+    void set_visible(bool visible) { m_visible = visible; }
+
     void update();
 
 private:
     static const size_t IMAGE_BUFFER_COUNT = 2;
+    static const size_t NO_BUFFER = ~(size_t)0;
+    static const int LOADER_PRIORITY = 2;
+    static const uint32_t LOADER_STACK_SIZE = 4096;
+
+    struct LoadedFrame {
+        size_t buffer;
+        size_t scene;
+        unsigned generation;
+        StripeMask changed;
+    };
 
     unsigned m_anim_frame_count;
-    float m_soul_change_probability;
-    bool m_in_intro;
+    const Playlist& m_playlist;
+    ClipCache& m_cache;
+    const FrameLoading m_loading;
+    uint32_t m_refresh_period_usec;
+    uint32_t m_frame_clock_usec;
+
+    // The loading cursor: what gets loaded next.  It belongs to the
+    // loader task in LOAD_IN_TASK mode.
+    size_t m_current_scene;
     const FlashImage *m_current_image;
     size_t m_image_frame_count;
     size_t m_current_frame;
+    size_t m_catch_up_frames;       // after seeking to a keyframe
+    unsigned m_change_generation;   // changes applied
+    size_t m_last_loaded_buffer;
+
+    // Stripes each buffer missed while other buffers were loaded.
+    StripeMask m_stale_stripes[IMAGE_BUFFER_COUNT];
+
+    // The display's last read of each buffer.
+    SPIDisplay *m_display;
+    TransactionID m_buffer_trans[IMAGE_BUFFER_COUNT];
+
+    // maybe_change_animation() asks the cursor's owner to switch clips.
+    std::atomic<bool> m_change_requested;
+    size_t m_requested_scene;
+    size_t m_requested_frame;
+    unsigned m_requests_posted;
+
+    // Only update() draws from it.
+    Random m_random;
+
+    // Picks the next scene when a clip ends.  It's rolled here so
+    // the loader task doesn't need the random number generator.
+    std::atomic<uint32_t> m_end_roll;
+
+    // What's on screen.
+    size_t m_displayed_scene;
+    const FlashImage *m_displayed_image;
+    unsigned m_displayed_generation;
     size_t m_current_image_buffer;
+    size_t m_retired_image_buffer;
+    unsigned m_frame_serial;
+    StripeMask m_changed_stripes;
+
+    // When streaming, where each stripe of the current frame starts.
+    const FlashImage *m_located_image;
+    const uint8_t *m_stripe_data[MAX_STRIPES];
+
+    // The dissolve.  It runs in update(), whatever the loading mode.
+    const unsigned m_dissolve_refreshes;
+    unsigned m_dissolve_step;
+    bool m_dissolve_handed_off;
+    size_t m_dissolve_scene;
+    const FlashImage *m_dissolve_image;
+    size_t m_dissolve_frame;
+    uint32_t m_dissolve_clock_usec;
+    const uint8_t *m_dissolve_stripe_data[MAX_STRIPES];
+
+    // LOAD_IN_TASK plumbing
+    TaskHandle_t m_loader_task;
+    SPSCQueue<size_t, IMAGE_BUFFER_COUNT> m_free_buffers;
+    SPSCQueue<LoadedFrame, IMAGE_BUFFER_COUNT> m_ready_frames;
+    unsigned m_late_frames;
+    bool m_frame_late;
+
+    bool m_visible;
 
     Animation(const Animation&) = delete;
     void operator = (const Animation&) = delete;
 
+    bool frame_due();
     void maybe_change_animation();
-    void load_frame(size_t);
+    void post_change_request(size_t scene, size_t frame);
+    void start_dissolve(size_t scene, size_t frame);
+    void update_dissolve();
+    void apply_change_request();
+    void set_cursor(size_t scene, size_t frame);
+    void advance_cursor();
+    StripeMask load_frame(size_t);
+    void locate_frame();
+    void take_loaded_frame();
+    void release_retired_buffer();
+    void await_buffer_reads(size_t buffer);
+
+    static void loader_task(void *);
+    void loader_loop();
 
-    static image_type s_image_buffers[IMAGE_BUFFER_COUNT];
+    static image_type *s_image_buffers;
 };
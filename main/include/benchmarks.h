@@ -1,3 +1,14 @@
 #pragma once
 
+class SPIDisplay;
+
 extern void run_memcpy_benchmarks();
+extern void run_decode_benchmarks();
+extern void run_crossfade_benchmarks();
+extern void run_noise_benchmarks();
+extern void run_overlay_benchmarks();
+// These two borrow the app's display, since only one SPIDisplay can
+// exist.  Call them between frames.  They leave the display idle with
+// its transfer limits back at their defaults.
+extern void run_display_benchmarks(SPIDisplay&);
+extern void run_transfer_sweep_benchmarks(SPIDisplay&);
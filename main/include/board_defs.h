@@ -14,6 +14,7 @@ const gpio_num_t UNDEFINED_GPIO = GPIO_NUM_MAX; // 49 on esp32s3
 
     #define DISPLAY_HEIGHT          280
     #define DISPLAY_WIDTH           240
+    #define DISPLAY_IS_ROUND        false
     #define DISPLAY_PIXEL_ORDER     EOrder::RGB565
     #define DISPLAY_PIXEL_ENDIAN    PixelEndian::BIG
     #define DISPLAY_SPI_HOST        SPI2_HOST
@@ -39,6 +40,7 @@ const gpio_num_t UNDEFINED_GPIO = GPIO_NUM_MAX; // 49 on esp32s3
 
     #define DISPLAY_HEIGHT          240
     #define DISPLAY_WIDTH           240
+    #define DISPLAY_IS_ROUND        true
     #define DISPLAY_PIXEL_ORDER     EOrder::BGR565
     #define DISPLAY_PIXEL_ENDIAN    PixelEndian::BIG
     #define DISPLAY_SPI_HOST        SPI2_HOST
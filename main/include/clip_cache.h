@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+class FlashImage;
+
+// ClipCache - copy the playing clip from flash into PSRAM
+//
+// A low priority task copies the clip's frames into one PSRAM
+// buffer, first frame first.  It runs on the core the refresh loop
+// doesn't use.  Frames that are copied are served from there; the
+// rest still come from flash.  If the clip doesn't fit,
+// only its first frames are cached.
+//
+// The cache holds one clip.  Asking for a frame of another clip
+// evicts the old one, so the caller must be done with any data it
+// got from the old clip.  Only one task may call frame_data().
+
+class ClipCache {
+
+public:
+    // max_bytes == 0 disables the cache.  So does a lack of PSRAM.
+    ClipCache(size_t max_bytes);
+    ~ClipCache();
+
+    bool enabled() const { return m_buffer != nullptr; }
+
+    // A copy of image->frame_data(i), or nullptr if it isn't
+    // cached (yet).
+    const uint8_t *frame_data(const FlashImage *image, size_t i);
+
+    unsigned hit_count() const { return m_hits; }
+    unsigned miss_count() const { return m_misses; }
+    void log_stats() const;
+
+private:
+    static const int FILL_PRIORITY = 1;
+    static const uint32_t FILL_STACK_SIZE = 3072;
+
+    uint8_t *m_buffer;
+    size_t m_capacity;
+
+    std::atomic<const FlashImage *> m_wanted;   // written by the reader
+    std::atomic<const FlashImage *> m_cached;   // written by the filler
+    std::atomic<size_t> m_ready_frames;         // written by the filler
+    TaskHandle_t m_fill_task;
+
+    unsigned m_hits;
+    unsigned m_misses;
+
+    ClipCache(const ClipCache&) = delete;
+    void operator = (const ClipCache&) = delete;
+
+    static void fill_task(void *);
+    void fill_loop();
+    void fill(const FlashImage *);
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Clip container and codecs
+//
+// Every clip partition starts with a ClipHeader.  The frame index,
+// an array of ClipFrameIndex, starts at `index_offset`.  Frame data
+// follows, each frame word aligned.  All integers are little endian.
+// Readers find the index through `index_offset`, so later versions
+// may grow the header.  `tools/gen_raw_image.py`
+// writes clips; FlashImage checks them against the firmware's build.
+//
+// Frames are stored raw (in the display's pixel format) or compressed.
+//
+// RLE compressed frames are a sequence of packets.  Each packet starts
+// with one header byte.
+//
+//   - 0b0nnnnnnn - literal.  n + 1 pixels follow.
+//   - 0b1nnnnnnn - run.  One pixel follows.  It is repeated n + 1 times.
+//
+// Pixels are two bytes in the display's byte order, so the decoder
+// never swizzles anything.  Packets are not aligned.  Packets never
+// span stripes of `SPIDisplay::STRIPE_HEIGHT` rows, so any stripe can
+// be decoded on its own once its start is known.
+//
+// DELTA compressed frames start with a 64 bit little endian mask of
+// the stripes that changed since the previous frame.  RLE packets for
+// each changed stripe follow in order.  Keyframes have every stripe.
+
+enum class ClipCodec : uint8_t {
+    RAW = 0,
+    RLE = 1,
+    DELTA = 2,
+};
+
+const char CLIP_MAGIC[4] = { 'S', 'C', 'L', 'P' };
+const uint16_t CLIP_VERSION = 1;
+
+struct ClipHeader {
+    char magic[4];              // CLIP_MAGIC
+    uint16_t version;           // CLIP_VERSION
+    uint16_t header_size;       // sizeof (ClipHeader)
+    uint16_t width;             // pixels
+    uint16_t height;
+    uint32_t pixel_order;       // an EOrder value
+    uint8_t pixel_endian;       // a PixelEndian value
+    uint8_t codec;              // a ClipCodec value
+    uint8_t stripe_height;      // rows per stripe
+    uint8_t reserved;
+    uint32_t frame_period_usec;
+    uint32_t frame_count;
+    uint32_t index_offset;      // from start of partition
+};
+static_assert(sizeof (ClipHeader) == 32);
+
+struct ClipFrameIndex {
+    uint32_t offset;            // from start of partition
+    uint32_t size;              // bytes
+    uint32_t flags;
+};
+static_assert(sizeof (ClipFrameIndex) == 12);
+
+const uint32_t CLIP_FRAME_KEYFRAME = 1 << 0;
+
+typedef uint64_t StripeMask;
+const size_t MAX_STRIPES = 64;
+
+inline StripeMask stripe_bit(size_t stripe)
+{
+    return (StripeMask)1 << stripe;
+}
+
+inline StripeMask all_stripes(size_t stripe_count)
+{
+    if (stripe_count >= MAX_STRIPES) {
+        return ~(StripeMask)0;
+    }
+    return stripe_bit(stripe_count) - 1;
+}
+
+const size_t RLE_MAX_PACKET_PIXELS = 128;
+const uint8_t RLE_RUN_BIT = 0x80;
+
+// Decode `pixel_count` pixels of RLE data from `src` into `dest`.
+// Returns the number of source bytes consumed.
+extern size_t rle_decode(void *dest, size_t pixel_count, const uint8_t *src);
+
+// Like rle_decode, but only walks the packet headers.
+extern size_t rle_skip(size_t pixel_count, const uint8_t *src);
+
+// Like rle_skip, but for untrusted data: it reads no more than
+// src_size bytes, and returns 0 if the packets run past pixel_count
+// or past the end of src.
+extern size_t rle_check(size_t pixel_count,
+                        const uint8_t *src,
+                        size_t src_size);
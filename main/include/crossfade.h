@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include "packed_color.h"
+
+// Crossfade - blend two runs of RGB565 pixels
+//
+// Each channel of dest is a + (b - a) * weight / CROSSFADE_WEIGHT_MAX,
+// rounded down.  weight 0 gives a, weight CROSSFADE_WEIGHT_MAX
+// gives b.  BGR565 blends the same way.  dest may be a or b.
+//
+// add_565() is the additive version, for laying noise over an
+// image: each channel of dest is a + b * weight / CROSSFADE_WEIGHT_MAX,
+// rounded down and saturated at the channel's maximum.
+//
+// crossfade_565() and add_565() use the ESP32-S3's PIE vector
+// instructions for big endian pixels.  Their pointers must be
+// DSP_ALIGNMENT aligned and pixel_count must be a multiple of
+// CROSSFADE_PIXEL_MULTIPLE.  The _reference() versions are plain
+// C++ and have no restrictions.  The two give identical results.
+
+const unsigned CROSSFADE_WEIGHT_BITS = 5;
+const unsigned CROSSFADE_WEIGHT_MAX = 1 << CROSSFADE_WEIGHT_BITS;
+const size_t CROSSFADE_PIXEL_MULTIPLE = 8;
+
+extern void crossfade_565(void *dest,
+                          const void *a,
+                          const void *b,
+                          size_t pixel_count,
+                          unsigned weight,
+                          PixelEndian);
+
+extern void crossfade_565_reference(void *dest,
+                                    const void *a,
+                                    const void *b,
+                                    size_t pixel_count,
+                                    unsigned weight,
+                                    PixelEndian);
+
+extern void add_565(void *dest,
+                    const void *a,
+                    const void *b,
+                    size_t pixel_count,
+                    unsigned weight,
+                    PixelEndian);
+
+extern void add_565_reference(void *dest,
+                              const void *a,
+                              const void *b,
+                              size_t pixel_count,
+                              unsigned weight,
+                              PixelEndian);
@@ -1,12 +1,13 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include "driver/gpio.h"
 #include "display_controllers.h"
 #include "driver/spi_master.h"
 
 struct SPIDisplayDesc {
-        size_t height;
+    size_t height;
     size_t width;
 
     spi_host_device_t spi_host;
@@ -18,6 +19,17 @@ struct SPIDisplayDesc {
     gpio_num_t cs_gpio; 
     gpio_num_t dc_gpio;
     gpio_num_t reset_gpio;
+
+    // How many pixel transactions the caller keeps queued at once.
+    size_t queue_size;
+
+    // The largest pixel transaction.  Larger than SPI_MAX_DMA_LEN
+    // uses a chain of DMA descriptors.
+    size_t max_transaction_bytes;
+
+    // Called from the SPI ISR when each queued pixel transaction
+    // finishes.  Must be in IRAM.
+    transaction_cb_t post_cb;
     // Could add...
     //   feature flags: VE, bidirectional, SPI width...
 };
@@ -29,9 +41,19 @@ public:
     ~SPIDisplayDriver();
 
     // DMA interface
-    void send_start_write_command(
+    //
+    // enqueue_start_write_command() queues CASET, PASET and RAMWR
+    // behind whatever is already queued, so a new address window
+    // doesn't wait for the bus to drain.  The SPI pre_cb drives DC
+    // for each transaction.  It only blocks if all WINDOW_SLOTS are
+    // in flight; window_slot_free() says whether it would.
+    //
+    // Pixel transactions must have a non-null user field.  The
+    // driver collects their results itself.
+    void enqueue_start_write_command(
         uint16_t x0, uint16_t y0,
         uint16_t x1, uint16_t y1);
+    bool window_slot_free() const;
     void enqueue_transaction(spi_transaction_t *);
     spi_transaction_t *await_transaction();
 
@@ -48,9 +70,22 @@ private:
     void delay_msec(uint32_t msec) override;
     void write_command(uint8_t cmd) override;
     void write_data(const uint8_t *data, size_t count) override;
-    void write_address(uint16_t addr1, uint16_t addr2);
     void write_bytes(const uint8_t *bytes, size_t count);
 
+    // Collect a finished transaction's result without waiting.
+    spi_transaction_t *reap_transaction();
+
+    // SPI ISR callbacks
+    static void pre_cb(spi_transaction_t *);
+    static void post_cb(spi_transaction_t *);
+
     SPIDisplayDesc m_desc;
     spi_device_handle_t m_device_handle;
+
+    // Address window commands: CASET, x0 x1, PASET, y0 y1, RAMWR.
+    static const size_t WINDOW_SLOTS = 4;
+    static const size_t WINDOW_STEPS = 5;
+    spi_transaction_t m_window_trans[WINDOW_SLOTS][WINDOW_STEPS];
+    std::atomic<bool> m_window_busy[WINDOW_SLOTS];
+    size_t m_window_rotor;
 };
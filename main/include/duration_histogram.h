@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// DurationHistogram - min, mean, max and percentiles of durations
+//
+// Min, mean and max are exact.  Percentiles come from log-linear
+// buckets, eight per octave, so they're within 1/8 (12.5%) above
+// the true value.  Values below 8 get a bucket each.  Adding a
+// sample is a few instructions and never allocates; the whole
+// histogram is about 1 KB.
+//
+// The unit is the caller's.  Microseconds and cycles both fit.
+
+class DurationHistogram {
+
+public:
+    DurationHistogram() { reset(); }
+
+    void reset()
+    {
+        for (auto& c : m_counts) {
+            c = 0;
+        }
+        m_count = 0;
+        m_sum = 0;
+        m_min = UINT32_MAX;
+        m_max = 0;
+    }
+
+    void add(uint32_t value)
+    {
+        m_counts[bucket_of(value)]++;
+        m_count++;
+        m_sum += value;
+        if (value < m_min) {
+            m_min = value;
+        }
+        if (value > m_max) {
+            m_max = value;
+        }
+    }
+
+    uint32_t count() const { return m_count; }
+    uint32_t min() const { return m_count ? m_min : 0; }
+    uint32_t max() const { return m_max; }
+    uint32_t mean() const { return m_count ? m_sum / m_count : 0; }
+
+    // The smallest bucket bound that at least `percent` percent of
+    // the samples are at or below, clamped to max().
+    uint32_t percentile(float percent) const
+    {
+        uint64_t wanted = (uint64_t)(percent * m_count / 100.0f + 0.5f);
+        if (wanted == 0) {
+            return min();
+        }
+        uint64_t seen = 0;
+        for (size_t b = 0; b < BUCKET_COUNT; b++) {
+            seen += m_counts[b];
+            if (seen >= wanted) {
+                uint32_t bound = bucket_max(b);
+                return bound < m_max ? bound : m_max;
+            }
+        }
+        return m_max;
+    }
+
+private:
+    static const unsigned SUB_BITS = 3;
+    static const uint32_t SUB_BUCKETS = 1 << SUB_BITS;
+    static const size_t BUCKET_COUNT = (32 - SUB_BITS + 1) * SUB_BUCKETS;
+
+    // Values below SUB_BUCKETS are their own bucket.  Above that,
+    // the top SUB_BITS + 1 bits pick the bucket.
+    static size_t bucket_of(uint32_t value)
+    {
+        if (value < SUB_BUCKETS) {
+            return value;
+        }
+        unsigned shift = 31 - __builtin_clz(value) - SUB_BITS;
+        return (shift + 1) * SUB_BUCKETS +
+               (value >> shift & (SUB_BUCKETS - 1));
+    }
+
+    // The largest value in bucket b.
+    static uint32_t bucket_max(size_t b)
+    {
+        if (b < SUB_BUCKETS) {
+            return b;
+        }
+        unsigned shift = b / SUB_BUCKETS - 1;
+        uint64_t low = (uint64_t)(SUB_BUCKETS + b % SUB_BUCKETS) << shift;
+        uint64_t high = low + ((uint64_t)1 << shift) - 1;
+        return high > UINT32_MAX ? UINT32_MAX : high;
+    }
+
+    uint32_t m_counts[BUCKET_COUNT];
+    uint32_t m_count;
+    uint64_t m_sum;
+    uint32_t m_min;
+    uint32_t m_max;
+};
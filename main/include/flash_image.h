@@ -3,7 +3,14 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include "clip_codec.h"
 #include "pixel_types.h"
+#include "spi_display.h"
+
+// A FlashImage is a video clip in a flash partition.
+// The clip format is described in clip_codec.h.  Partitions whose
+// clips don't match this build (size, pixel format, stripes...)
+// are rejected at mount time.
 
 class FlashImage {
 
@@ -11,36 +18,93 @@ public:
     static const size_t FRAME_PIXEL_COUNT = IMAGE_HEIGHT * IMAGE_WIDTH;
     static const size_t FRAME_SIZE = FRAME_PIXEL_COUNT * sizeof (pixel_type);
 
+    // Compressed clips are encoded in stripes of this many rows.
+    static const size_t STRIPE_HEIGHT = SPIDisplay::STRIPE_HEIGHT;
+    static const size_t STRIPE_COUNT = IMAGE_HEIGHT / STRIPE_HEIGHT;
+    static const size_t STRIPE_PIXEL_COUNT = STRIPE_HEIGHT * IMAGE_WIDTH;
+    static_assert(IMAGE_HEIGHT % STRIPE_HEIGHT == 0);
+    static_assert(STRIPE_COUNT <= MAX_STRIPES);
+
     static const size_t MAX_LABEL_SIZE = 16;
     static FlashImage *get_by_label(const char *);
 
-    static const size_t MAX_IMAGES = 3;
+    // Every valid clip partition, in partition table order.
+    static size_t count();
     static FlashImage *get_by_index(size_t);
 
     const char *label() const { return m_label; }
     size_t size_bytes() const { return m_size; }
-    size_t frame_count() const { return m_size / FRAME_SIZE; }
+    size_t frame_count() const { return m_frame_count; }
+    ClipCodec codec() const { return m_codec; }
+    uint32_t frame_period_usec() const { return m_frame_period_usec; }
     const void *base_addr() const { return m_addr; }
+
+    // Only raw clips have directly addressable frames.
     const image_type *frame_addr(size_t i) const
     {
-        assert(i < frame_count());
-        return (const image_type *)m_addr + i;
+        assert(m_codec == ClipCodec::RAW);
+        return (const image_type *)frame_data(i);
+    }
+
+    // Encoded frame data, whatever the codec.
+    const uint8_t *frame_data(size_t i) const
+    {
+        assert(i < m_frame_count);
+        return (const uint8_t *)m_addr + m_index[i].offset;
+    }
+    size_t frame_data_size(size_t i) const
+    {
+        assert(i < m_frame_count);
+        return m_index[i].size;
     }
 
+    // Which stripes frame i changes.  Every stripe unless
+    // the clip is DELTA encoded.
+    StripeMask frame_stripe_mask(size_t i) const;
+    bool is_keyframe(size_t i) const
+    {
+        assert(i < m_frame_count);
+        return m_index[i].flags & CLIP_FRAME_KEYFRAME;
+    }
+    size_t keyframe_at_or_before(size_t i) const;
+
+    // Decode (or copy) frame i into dest.  Only the stripes in
+    // frame_stripe_mask(i) are written.  `data` is a copy of
+    // frame_data(i) to read instead of flash, if there is one.
+    void read_frame(size_t i,
+                    image_type *dest,
+                    const uint8_t *data = nullptr) const;
+
+    // Find where each stripe in frame_stripe_mask(i) starts.
+    // Other entries of `stripe_data` are left alone.
+    void locate_stripes(size_t i,
+                        const uint8_t **stripe_data,
+                        const uint8_t *data = nullptr) const;
+
+    // Decode (or copy) one stripe found by locate_stripes.
+    void read_stripe(const uint8_t *stripe_data, pixel_type *dest) const;
+
 private:
     FlashImage() = default;
     FlashImage(const FlashImage&) = delete;
     void operator = (const FlashImage&) = delete;
     ~FlashImage();
 
+    bool parse_header();
+
     // instance members
     char m_label[MAX_LABEL_SIZE + 1];
     const void *m_addr;
     size_t m_size;
     uint32_t m_handle;
+    ClipCodec m_codec;
+    uint32_t m_frame_period_usec;
+    size_t m_frame_count;
+    const ClipFrameIndex *m_index;
 
     // static members
-    static FlashImage images[MAX_IMAGES];
+    static FlashImage *images;
     static size_t image_count;
+    static bool images_found;
     static void find_images();
 };
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <cstddef>
+#include <vector>
 #include "driver_backlight.h"
 
 class SpookyFlickerEffect {
@@ -12,53 +13,79 @@ public:
     SpookyFlickerEffect(
         Backlight& backlight,
         unsigned anim_frame_count,
-        bool enabled = true)
-    : m_backlight(backlight),
-      m_anim_frame_count(anim_frame_count),
-      m_frame(0),
-      m_scale(calc_scale()),
-      m_enabled(enabled)
-    {}
+        bool enabled = true);
 
     unsigned animation_frame_count() const { return m_anim_frame_count; }
+
+    // Any frame's brightness, computed from scratch.
     float frame_brightness(unsigned frame) const
     {
         return spooky_flicker_function(frame) * m_scale;
     }
 
+    // The brightness update() last set.
+    float brightness() const { return m_brightness; }
+
     bool enabled() const { return m_enabled; }
 
-    void set_animation_frame_count(unsigned count)
-    {
-        m_anim_frame_count = count;
-        m_frame = 0;
-        m_scale = calc_scale();
-    }
+    // How many refreshes, starting with the one update() just lit,
+    // the backlight stays off.  Zero if it's on or the effect is
+    // disabled.
+    unsigned dark_refreshes() const { return m_dark_refreshes; }
+
+    void set_animation_frame_count(unsigned count);
 
     void set_enabled(bool enabled = true)
     {
         m_enabled = enabled;
+        m_dark_refreshes = 0;
     }
 
-    void update()
-    {
-        if (m_enabled) {
-            float brightness = frame_brightness(m_frame);
-            m_backlight.set_brightness(brightness);
-        }
-        m_frame = (m_frame + 1) % m_anim_frame_count;
-    }
+    void update();
 
 private:
 
+    // update() doesn't evaluate the sines.  Each one is a phasor
+    // turned by one frame's angle per refresh, which is a few
+    // multiply-adds.  Every RESYNC_FRAMES frames the phasors are
+    // set from sin and cos again so rounding doesn't build up.
+    static const unsigned RESYNC_FRAMES = 256;
+
+    struct Phasors {
+        unsigned frame;
+        float re[HARMONICS];
+        float im[HARMONICS];
+    };
+
+    // A stretch of frames where the curve is zero.  A run that
+    // reaches the end of the loop carries on into one at frame 0, and
+    // its length counts both.
+    struct DarkRun {
+        unsigned start;
+        unsigned length;
+    };
+
     float spooky_flicker_function(unsigned frame) const;
-    float calc_scale();
+    float phasor_function(const Phasors&) const;
+    void seek(Phasors&, unsigned frame) const;
+    void step(Phasors&) const;
+    float calc_scale() const;
+    void find_dark_runs();
+    unsigned dark_frames_from(unsigned frame) const;
 
     Backlight& m_backlight;
     unsigned m_anim_frame_count;
-    unsigned m_frame;
     float m_scale;
     bool m_enabled;
+    unsigned m_dark_refreshes;
+    float m_brightness;
+
+    // One frame's turn of each phasor.
+    float m_turn_re[HARMONICS];
+    float m_turn_im[HARMONICS];
+    Phasors m_phasors;
 
-    // static float s_frequencies[HARMONICS];
+    // The loop's dark runs, in order, so update() doesn't have to
+    // step ahead to find where one ends.
+    std::vector<DarkRun> m_dark_runs;
 };
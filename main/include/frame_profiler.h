@@ -0,0 +1,172 @@
+#pragma once
+
+#include <cinttypes>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "duration_histogram.h"
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+
+// FrameProfiler - where each refresh's time goes
+//
+// The refresh loop is split into phases, and each phase is timed
+// with the CPU cycle counter:
+//
+//     enum Phase { DRAW, SEND, PHASE_COUNT };
+//     const char *const NAMES[PHASE_COUNT] = { "draw", "send" };
+//     FrameProfiler<PHASE_COUNT> profiler(NAMES, 60.0f, 3600);
+//
+//     while (1) {
+//         { auto t = profiler.time(DRAW); draw(); }
+//         { auto t = profiler.time(SEND); send(); }
+//         profiler.end_refresh();
+//     }
+//
+// Each phase has a histogram of its time per refresh, and so does
+// the whole refresh.  When a refresh runs over its budget, the
+// phase that took longest is blamed.  The stats are logged every
+// log_period refreshes (zero never does) or by log_stats().
+//
+// Nothing is allocated.  FrameProfiler<N, false> has the same
+// interface and compiles to nothing.
+
+template <size_t PHASES, bool ENABLED = true>
+class FrameProfiler {
+
+public:
+    // Times one phase, from construction to destruction.
+    class Timer {
+
+    public:
+        Timer(FrameProfiler& profiler, size_t phase)
+        : m_profiler(profiler),
+          m_phase(phase),
+          m_start(esp_cpu_get_cycle_count())
+        {}
+
+        ~Timer()
+        {
+            uint32_t cycles = esp_cpu_get_cycle_count() - m_start;
+            m_profiler.m_refresh_cycles[m_phase] += cycles;
+        }
+
+    private:
+        Timer(const Timer&) = delete;
+        void operator = (const Timer&) = delete;
+
+        FrameProfiler& m_profiler;
+        const size_t m_phase;
+        const uint32_t m_start;
+    };
+
+    FrameProfiler(const char *const (&names)[PHASES],
+                  float refresh_hz,
+                  unsigned log_period)
+    : m_names(names),
+      m_budget_cycles(CYCLES_PER_USEC * 1e6f / refresh_hz),
+      m_log_period(log_period),
+      m_refresh_cycles{},
+      m_blamed{},
+      m_over_budget(0)
+    {}
+
+    Timer time(size_t phase) { return Timer(*this, phase); }
+
+    void end_refresh()
+    {
+        uint32_t total = 0;
+        size_t worst = 0;
+        for (size_t i = 0; i < PHASES; i++) {
+            uint32_t cycles = m_refresh_cycles[i];
+            m_phases[i].add(cycles);
+            total += cycles;
+            if (cycles > m_refresh_cycles[worst]) {
+                worst = i;
+            }
+        }
+        m_total.add(total);
+        if (total > m_budget_cycles) {
+            m_over_budget++;
+            m_blamed[worst]++;
+        }
+        for (auto& c : m_refresh_cycles) {
+            c = 0;
+        }
+
+        if (m_log_period && m_total.count() >= m_log_period) {
+            log_stats();
+            reset();
+        }
+    }
+
+    void reset()
+    {
+        for (auto& h : m_phases) {
+            h.reset();
+        }
+        m_total.reset();
+        for (auto& b : m_blamed) {
+            b = 0;
+        }
+        m_over_budget = 0;
+    }
+
+    void log_stats() const
+    {
+        printf("FrameProfiler: %" PRIu32 " refreshes, %" PRIu32
+               " over the %.0f usec budget\n",
+               m_total.count(), m_over_budget,
+               m_budget_cycles / CYCLES_PER_USEC);
+        printf("FrameProfiler: usec        mean     p99     max  "
+               "%% budget  blamed\n");
+        for (size_t i = 0; i < PHASES; i++) {
+            log_row(m_names[i], m_phases[i], m_blamed[i]);
+        }
+        log_row("total", m_total, m_over_budget);
+    }
+
+private:
+    static constexpr float CYCLES_PER_USEC =
+        CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+
+    void log_row(const char *name,
+                 const DurationHistogram& h,
+                 uint32_t blamed) const
+    {
+        printf("FrameProfiler: %-10s %7.1f %7.1f %7.1f %8.1f%% %7" PRIu32
+               "\n",
+               name,
+               h.mean() / CYCLES_PER_USEC,
+               h.percentile(99) / CYCLES_PER_USEC,
+               h.max() / CYCLES_PER_USEC,
+               100.0f * h.mean() / m_budget_cycles,
+               blamed);
+    }
+
+    const char *const (&m_names)[PHASES];
+    const uint32_t m_budget_cycles;
+    const unsigned m_log_period;
+    uint32_t m_refresh_cycles[PHASES];
+    DurationHistogram m_phases[PHASES];
+    DurationHistogram m_total;
+    uint32_t m_blamed[PHASES];
+    uint32_t m_over_budget;
+};
+
+// Disabled: every call is empty and inline.
+template <size_t PHASES>
+class FrameProfiler<PHASES, false> {
+
+public:
+    struct Timer {
+        ~Timer() {}     // so unused Timers don't warn
+    };
+
+    FrameProfiler(const char *const (&)[PHASES], float, unsigned) {}
+
+    Timer time(size_t) { return Timer(); }
+    void end_refresh() {}
+    void reset() {}
+    void log_stats() const {}
+};
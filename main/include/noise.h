@@ -0,0 +1,72 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "dsp_memcpy.h"
+#include "packed_color.h"
+
+// NoiseGenerator - fill pixels with random grey, fast
+//
+// Four xorshift32 generators run side by side, one per 32 bit lane
+// of a PIE register.  Each 32 bit output makes two pixels: six
+// random bits of green, and red and blue from its top five bits.
+// That's every grey RGB565 (or BGR565) can show.
+//
+// fill_565() writes 16 bytes at a time with PIE for big endian
+// pixels.  Its pointer must be DSP_ALIGNMENT aligned and
+// pixel_count must be a multiple of NOISE_PIXEL_MULTIPLE.
+// fill_565_reference() is plain C++.  The two write the same
+// pixels and leave the generator in the same state.
+
+const size_t NOISE_PIXEL_MULTIPLE = 8;
+
+class NoiseGenerator {
+
+public:
+    NoiseGenerator(uint32_t seed);
+
+    void fill_565(void *dest, size_t pixel_count, PixelEndian);
+    void fill_565_reference(void *dest, size_t pixel_count, PixelEndian);
+
+private:
+    static const size_t LANES = 4;
+
+    uint32_t m_state[LANES] DSP_ALIGNED_ATTR;
+};
+
+// NoiseBank - serve static from noise made ahead of time
+//
+// The bank is filled once from a NoiseGenerator.  Each row that
+// fill_565() writes is a random row of the bank, rotated by a
+// random even number of pixels and XORed with a random grey.  (XOR
+// with a grey is still grey.)  That's a copy and an XOR per word,
+// and a 32 KB bank of 240 pixel rows gives half a million distinct
+// rows.
+//
+// The caller owns the storage.  It must be DSP_ALIGNMENT aligned,
+// and row_pixels must be a multiple of NOISE_PIXEL_MULTIPLE.  dest
+// must be word aligned.
+
+class NoiseBank {
+
+public:
+    NoiseBank(void *storage,
+              size_t storage_bytes,
+              size_t row_pixels,
+              PixelEndian,
+              uint32_t seed);
+
+    size_t row_count() const { return m_row_count; }
+
+    void fill_565(void *dest, size_t row_count);
+
+private:
+    NoiseBank(const NoiseBank&) = delete;
+    void operator = (const NoiseBank&) = delete;
+
+    const uint32_t *m_rows;
+    const size_t m_row_words;
+    const size_t m_row_count;
+    const PixelEndian m_endian;
+    uint32_t m_pick;
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// PanelSpans - which pixels of an image a panel can show
+//
+// A round panel, like the GC9A01's, shows the circle inscribed in
+// its square frame memory; the corners aren't there.  PanelSpans
+// works out once, for an image centered on the panel, the columns
+// of each image row that land in the circle.  A pixel counts if any
+// part of it is inside.  On a rectangular panel every row is whole.
+//
+// Spans are half open, [x0, x1), in image coordinates.  A stripe's
+// span covers the spans of all its rows, so the stripe can go out
+// as one rectangle through one address window.
+
+class PanelSpans {
+
+public:
+    struct Span {
+        uint16_t x0;
+        uint16_t x1;
+
+        size_t width() const { return x1 - x0; }
+    };
+
+    PanelSpans(size_t panel_width,
+               size_t panel_height,
+               bool round,
+               size_t image_width,
+               size_t image_height);
+
+    size_t image_width() const { return m_image_width; }
+    Span row(size_t y) const { return m_rows[y]; }
+    Span stripe(size_t y, size_t height) const;
+    bool is_whole(Span s) const { return s.x0 == 0 && s.x1 == m_image_width; }
+
+    // Pack the stripe's span of each row together, row after row,
+    // in dest.  dest may be src.  Returns the stripe's span.
+    Span gather(void *dest,
+                const void *src,
+                size_t y,
+                size_t height,
+                size_t pixel_size) const;
+
+private:
+    size_t m_image_width;
+    std::vector<Span> m_rows;
+};
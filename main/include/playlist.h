@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+class FlashImage;
+
+// A Playlist decides which clip plays next.
+//
+// The rules are a table of scenes, one per clip, written as data
+// (see main.cpp).  Clips are named by partition label, but labels
+// are only looked up once, at construction.  After that, scenes are
+// small integers and every transition is a table lookup.
+//
+// A scene can go somewhere when its clip ends (otherwise it loops),
+// and it can be interrupted when the flicker effect loops, with some
+// probability.  Either way, the next scene is chosen at random from
+// a short list.  The first rule is the starting scene.
+
+class Playlist {
+
+public:
+    static const size_t MAX_CHOICES = 4;
+    static const size_t NO_SCENE = ~(size_t)0;
+
+    struct Rule {
+        const char *clip;                       // partition label
+        const char *on_end[MAX_CHOICES];        // empty: loop
+        const char *on_flicker_loop[MAX_CHOICES];
+        float flicker_loop_probability;
+    };
+
+    Playlist(const Rule *rules, size_t rule_count);
+    ~Playlist();
+
+    size_t first_scene() const { return 0; }
+    const FlashImage *clip(size_t scene) const
+    {
+        return m_scenes[scene].clip;
+    }
+
+    // `roll` is any random number.
+    size_t after_end(size_t scene, uint32_t roll) const;
+
+    // `chance` is uniform in [0, 1).  Returns NO_SCENE if the scene
+    // isn't interrupted this time.
+    size_t after_flicker_loop(size_t scene,
+                              float chance,
+                              uint32_t roll) const;
+
+private:
+    struct Choices {
+        size_t count;
+        size_t scenes[MAX_CHOICES];
+    };
+
+    struct Scene {
+        const FlashImage *clip;
+        Choices on_end;
+        Choices on_flicker_loop;
+        float flicker_loop_probability;
+    };
+
+    size_t m_scene_count;
+    Scene *m_scenes;
+
+    Playlist(const Playlist&) = delete;
+    void operator = (const Playlist&) = delete;
+
+    size_t find_scene(const char *label) const;
+    void resolve(const char *const *labels, Choices&) const;
+    static size_t choose(const Choices&, uint32_t roll);
+};
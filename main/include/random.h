@@ -1,38 +1,125 @@
 #pragma once
 
-#include <cstdlib>
+#include <cassert>
+#include <cstdint>
 
-class Random {
+// Random number streams
+//
+// Each subsystem owns its own stream, so one subsystem's draws
+// don't disturb another's sequence and no state is shared between
+// tasks.  Streams are seeded from a session seed and a stream ID.
+// The session seed comes from the hardware RNG unless the app sets
+// one, and it is logged, so a session can be replayed exactly.
+//
+// The generators are small and header only.
+//   Pcg32      - PCG XSH RR.  64 bits of state, independent streams.
+//   Xorshift32 - 32 bits of state.  Fastest, lower quality.
+
+// One per subsystem.  Don't reuse IDs.
+enum RandomStreamID : uint32_t {
+    RANDOM_STREAM_ANIMATION = 1,
+    RANDOM_STREAM_STATIC = 2,
+    RANDOM_STREAM_TEAR = 3,
+    RANDOM_STREAM_CHANNEL_SHIFT = 4,
+};
+
+// Call before any stream is created.  Zero means use the hardware
+// RNG.
+extern void set_random_session_seed(uint64_t seed);
+extern uint64_t random_session_seed();
+
+class Pcg32 {
+
+public:
+    Pcg32(uint64_t seed, uint32_t stream)
+    : m_state(0),
+      m_inc((uint64_t)stream << 1 | 1)
+    {
+        next();
+        m_state += seed;
+        next();
+    }
+
+    uint32_t next()
+    {
+        uint64_t old = m_state;
+        m_state = old * 6364136223846793005ULL + m_inc;
+        uint32_t xorshifted = ((old >> 18) ^ old) >> 27;
+        uint32_t rot = old >> 59;
+        return xorshifted >> rot | xorshifted << (-rot & 31);
+    }
+
+private:
+    uint64_t m_state;
+    uint64_t m_inc;
+};
+
+class Xorshift32 {
 
 public:
-    // Procedural interface
-    static void srand(unsigned seed) { s_instance.o_srand(seed); }
-    static unsigned rand() { return s_instance.o_rand(); }
+    Xorshift32(uint64_t seed, uint32_t stream)
+    {
+        // splitmix64 so nearby seeds and streams don't start out
+        // correlated.  xorshift is stuck at zero, so avoid it.
+        uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ULL;
+        z = (z ^ z >> 30) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ z >> 27) * 0x94D049BB133111EBULL;
+        z ^= z >> 31;
+        m_state = (uint32_t)z ? (uint32_t)z : 1;
+    }
+
+    uint32_t next()
+    {
+        uint32_t x = m_state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        return m_state = x;
+    }
+
+private:
+    uint32_t m_state;
+};
+
+template <class Generator>
+class RandomStream {
+
+public:
+    RandomStream(RandomStreamID id)
+    : m_gen(random_session_seed(), id)
+    {}
+    RandomStream(uint64_t seed, uint32_t stream)
+    : m_gen(seed, stream)
+    {}
+
+    // 32 random bits
+    uint32_t rand() { return m_gen.next(); }
 
     // N.B. randint returns a number strictly less than max,
-    // unlike std::experimental::randint.
-    // randint is also biased.  It's cheaper than an unbiased version.
+    // unlike std::experimental::randint.  It is unbiased
+    // (Lemire's method), and usually costs one multiply.
     template <class MinType, class MaxType>
-    static MaxType randint(MinType min, MaxType max) {
-        assert(0 <= min);
-        assert(max <= RAND_MAX);
-        return (MaxType)s_instance.o_randint(min, max); 
+    MaxType randint(MinType min, MaxType max)
+    {
+        assert(0 <= min && (uint64_t)min < (uint64_t)max);
+        assert((uint64_t)max - (uint64_t)min <= UINT32_MAX);
+        uint32_t range = (uint64_t)max - (uint64_t)min;
+        uint64_t m = (uint64_t)rand() * range;
+        if ((uint32_t)m < range) {
+            uint32_t threshold = -range % range;
+            while ((uint32_t)m < threshold) {
+                m = (uint64_t)rand() * range;
+            }
+        }
+        return (MaxType)(min + (m >> 32));
     }
 
+    // [0, 1)
+    float uniform() { return (rand() >> 8) * (1.0f / (1 << 24)); }
+
 private:
-    Random();
-    Random(const Random&) = delete;
-    void operator = (const Random&) = delete;
-    ~Random() {}
-
-    // Object interface is private.
-    // We do this so we can privately use a noise source as
-    // the default seed.
-    void o_srand(unsigned seed) { std::srand(seed); }
-    unsigned o_rand();
-    unsigned o_randint(unsigned min, unsigned max) {
-        return min + o_rand() % (max - min);
-    }
- 
-    static Random s_instance;
+    Generator m_gen;
 };
+
+typedef RandomStream<Pcg32> Random;
+typedef RandomStream<Xorshift32> FastRandom;
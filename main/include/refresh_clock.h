@@ -3,16 +3,30 @@
 // RefreshClock - block until it's time to refresh the screen
 // It unblocks at a steady 60 Hz (or whatever) so on-screen
 // animations are smooth.
+//
+// The clock runs on esp_timer, so the period is exact to the
+// microsecond and doesn't depend on the FreeRTOS tick.  Deadlines
+// are absolute; late wakeups don't push later ones back.
+//
+// It also watches the loop it drives.  Each period it records how
+// late wait() returned (wake latency), how long the caller took to
+// call wait() again (loop time), and whether that was past the next
+// deadline (a missed deadline).  They're logged every
+// LOG_PERIOD_SEC.
 class RefreshClock {
 
 public:
+    static const unsigned LOG_PERIOD_SEC = 60;
+
     RefreshClock(float freq_hz);
     ~RefreshClock();
 
     void wait();
 
+    void log_stats() const;
+
 private:
     // put the implementation into a private object to
-    // keep the FreeRTOS dependency out of the header.
+    // keep the ESP-IDF dependency out of the header.
     struct RefreshClock_private *m_private;
 };
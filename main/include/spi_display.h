@@ -4,40 +4,99 @@
 #include <cstdint>
 #include "board_defs.h"
 #include "pixel_types.h"
+#include "sdkconfig.h"
 
 typedef int32_t TransactionID;
+const TransactionID NO_TRANSACTION = -1;
 
 class SPIDisplay {
 
 public:
-    static const size_t STRIPE_HEIGHT = 8;
+    // Build-time tuning, set in the Kconfig menu.
+    static const size_t STRIPE_HEIGHT = CONFIG_DISPLAY_STRIPE_HEIGHT;
+    static const size_t TRANSACTION_POOL_SIZE =
+        CONFIG_DISPLAY_TRANSACTION_POOL_SIZE;
+    static const size_t SPI_QUEUE_DEPTH = CONFIG_DISPLAY_SPI_QUEUE_DEPTH;
+    static const size_t MAX_TRANSACTION_BYTES =
+        CONFIG_DISPLAY_MAX_TRANSACTION_BYTES;
 
     SPIDisplay();
     ~SPIDisplay();
 
     size_t height() const { return m_display_height; }
     size_t width() const { return m_display_width; }
+    bool is_round() const { return DISPLAY_IS_ROUND; }
 
     // To stream video, call begin_frame, call send_stripe repeatedly,
     // then call end_frame.
     // Repeat for every frame at your own pace.
-    // send_stripe blocks.  begin_frame() and end_frame() don't.
+    // send_stripe blocks while all its transactions are in flight.
+    // Finished ones are recycled from the SPI interrupt, so the
+    // caller sleeps instead of polling.  begin_frame() and
+    // end_frame() don't block.
+    // Stripes must be sent top to bottom, but may skip rows.
+    // Skipping queues a new address window.
     // send_stripe returns a transaction ID; clients should
     // call await_transaction before reusing the pixel memory.
+    // Awaiting NO_TRANSACTION or a long finished one returns at once.
+    //
+    // A stripe that continues the last one, in rows and in memory,
+    // is merged into the same transaction, up to the transaction
+    // size limit, and gets the same ID.  While the bus is busy, the
+    // last stripe is held back so the next one can join it.  It is
+    // sent when a stripe doesn't join, at end_frame(), when it is
+    // awaited or asked about, or by flush().  Call flush() before
+    // long work between stripes, or the bus may sit idle.
 
     void begin_frame_centered(size_t width, size_t height);
     void begin_frame(size_t width, size_t height, 
                      size_t x_offset, size_t y_offset);
     void end_frame();
+    void flush();
     TransactionID send_stripe(
         size_t y, size_t height, const pixel_type *pixels
     );
     void await_transaction(TransactionID);
 
+    // Send only columns [x0, x1) of the frame's rows.  pixels holds
+    // x1 - x0 pixels per row.  It gets its own address window, so a
+    // following stripe does too.
+    TransactionID send_clipped_stripe(
+        size_t y, size_t height,
+        size_t x0, size_t x1,
+        const pixel_type *pixels
+    );
+
+    // try_send_stripe is send_stripe without the blocking: if the
+    // stripe can't be queued yet, it returns NO_TRANSACTION and the
+    // caller can do something else and try again.
+    // A skip or a new frame queues a new address window behind the
+    // stripes before it; the bus doesn't drain.
+    TransactionID try_send_stripe(
+        size_t y, size_t height, const pixel_type *pixels
+    );
+    bool transaction_done(TransactionID);
+
+    // Change the limits at run time, for benchmarks.  max_in_flight
+    // is at most TRANSACTION_POOL_SIZE and SPI_QUEUE_DEPTH.  A
+    // max_transaction_bytes less than a stripe turns merging off.
+    void set_transfer_limits(size_t max_in_flight,
+                             size_t max_transaction_bytes);
+
+    // Pixel transactions queued so far.
+    size_t transaction_count() const { return m_transaction_count; }
+
 private:
     SPIDisplay(const SPIDisplay&) = delete;
     void operator = (const SPIDisplay&) = delete;
 
+    TransactionID queue_stripe(
+        size_t y, size_t height,
+        size_t x0, size_t x1,
+        const pixel_type *pixels,
+        bool wait
+    );
+
     struct SPIDisplayDriver *m_driver;
     size_t m_display_height;
     size_t m_display_width;
@@ -51,4 +110,14 @@ private:
     bool m_frame_ready;
     uint8_t m_frame;
     size_t m_current_y;
+    size_t m_window_x0;
+    size_t m_window_x1;
+    size_t m_max_in_flight;
+    size_t m_max_transaction_bytes;
+    size_t m_transaction_count;
+
+    // The stripe being held back for merging, if any.
+    struct Transaction *m_pending;
+    const uint8_t *m_pending_data;
+    size_t m_pending_bytes;
 };
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// SPSCQueue - lock-free single producer, single consumer queue
+//
+// One task may push and one other task (or ISR) may pop.  Nothing
+// blocks; push fails when full and pop fails when empty.  Pair it
+// with a task notification if the consumer needs to sleep.
+
+template <class T, size_t CAPACITY> class SPSCQueue {
+
+public:
+    SPSCQueue() : m_head(0), m_tail(0) {}
+
+    bool push(const T& item)
+    {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        size_t head = m_head.load(std::memory_order_acquire);
+        if (tail - head == CAPACITY) {
+            return false;
+        }
+        m_items[tail % CAPACITY] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item)
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+        item = m_items[head % CAPACITY];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Look at the next item without popping it.  Consumer only.
+    // The producer doesn't touch it until it's popped.
+    bool peek(T& item) const
+    {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        if (head == tail) {
+            return false;
+        }
+        item = m_items[head % CAPACITY];
+        return true;
+    }
+
+    // Approximate when called from a third party.
+    size_t size() const
+    {
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        size_t head = m_head.load(std::memory_order_acquire);
+        return tail - head;
+    }
+
+    bool empty() const { return size() == 0; }
+
+private:
+    SPSCQueue(const SPSCQueue&) = delete;
+    void operator = (const SPSCQueue&) = delete;
+
+    std::atomic<size_t> m_head;     // written by the consumer
+    std::atomic<size_t> m_tail;     // written by the producer
+    T m_items[CAPACITY];
+};
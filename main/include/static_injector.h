@@ -1,6 +1,8 @@
 #pragma once
 
+#include "noise.h"
 #include "pixel_types.h"
+#include "random.h"
 
 class StaticInjector {
 
@@ -9,14 +11,34 @@ public:
     static const int MAX_STATIC = 1200; // 1200 stripes = 40 frames = .67 sec
     static const int MIN_NO_STATIC = 150; // 150 stripes = 5 frames = 8.3 ms
     static const int MAX_NO_STATIC = 4000; // 4000 stripes = 133 frames = 2.2 s
+    static const int RAMP_STATIC = 90; // 90 stripes = 3 frames = 50 ms
 
-    StaticInjector();
+    // With bank_bytes, static is served from a bank of noise made
+    // at startup instead of generated for every stripe.
+    StaticInjector(size_t bank_bytes);
+    ~StaticInjector();
 
+    // Call once per stripe.  True if the stripe gets static.
     bool update();
 
+    // How strong the static is, 1 to CROSSFADE_WEIGHT_MAX.  It ramps
+    // up over RAMP_STATIC stripes at the start of a burst and back
+    // down at the end.  Only valid when update() returned true.
+    unsigned intensity() const;
+
+    // pixels must be DSP_ALIGNMENT aligned, and count a multiple
+    // of IMAGE_WIDTH.
     void fill_with_static(pixel_type *pixels, size_t count);
 
 private:
+    StaticInjector(const StaticInjector&) = delete;
+    void operator = (const StaticInjector&) = delete;
+
     int m_active;
+    int m_length;
     int m_start;
+    Random m_random;
+    NoiseGenerator m_noise;
+    void *m_bank_storage;
+    NoiseBank *m_bank;
 };
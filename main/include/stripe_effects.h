@@ -0,0 +1,264 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <tuple>
+#include <utility>
+#include "esp_cpu.h"
+#include "clip_codec.h"
+#include "pixel_types.h"
+#include "random.h"
+#include "spi_display.h"
+
+// Stripe Effects - transform stripes on their way to the display
+//
+// VideoStreamer hands each stripe to the effect chain in the DMA
+// bounce buffer it's about to send, and each stage changes it in
+// place.  The stages are chosen at build time:
+//
+//     StripeEffects<TearEffect, VignetteEffect> effects(
+//         TearEffect(...), VignetteEffect(...));
+//
+// A stage that isn't listed isn't compiled in.  A stage is any class
+// with
+//
+//     static constexpr const char *NAME;
+//
+//     // True if the stage's output changes from refresh to refresh.
+//     // Stripes an animated stage touched are resent on the next
+//     // refresh, so the effect is erased when it moves on.
+//     static const bool ANIMATED;
+//
+//     void begin_refresh(unsigned refresh);
+//     bool applies(size_t y, size_t height) const;
+//     void apply(pixel_type *stripe, size_t y, size_t height);
+
+class StripeEffectChain {
+
+public:
+    virtual ~StripeEffectChain() {}
+
+    // Call once at the start of each refresh.
+    virtual void begin_refresh() = 0;
+
+    // Stripes that must be sent this refresh, whether or not the
+    // video changed them.
+    virtual StripeMask forced_stripes() const = 0;
+
+    // True if apply() would change this stripe.
+    virtual bool applies(size_t y, size_t height) const = 0;
+
+    virtual void apply(pixel_type *stripe, size_t y, size_t height) = 0;
+
+    virtual void log_stats() const = 0;
+};
+
+template <class... Stages>
+class StripeEffects : public StripeEffectChain {
+
+public:
+    // Log stage timing this often.  One minute at 60 Hz.
+    static const unsigned LOG_PERIOD_REFRESHES = 3600;
+
+    StripeEffects(Stages... stages)
+    : m_stages(stages...),
+      m_refresh(0),
+      m_touched(0),
+      m_forced(0),
+      m_cycles{},
+      m_stripes{}
+    {}
+
+    void begin_refresh() override
+    {
+        std::apply([&](auto&... s) { (s.begin_refresh(m_refresh), ...); },
+                   m_stages);
+        if (++m_refresh % LOG_PERIOD_REFRESHES == 0) {
+            log_stats();
+        }
+
+        const size_t H = SPIDisplay::STRIPE_HEIGHT;
+        StripeMask touched = 0;
+        for (size_t y = 0; y < IMAGE_HEIGHT; y += H) {
+            if (animated_applies(y, H)) {
+                touched |= stripe_bit(y / H);
+            }
+        }
+        m_forced = touched | m_touched;
+        m_touched = touched;
+    }
+
+    StripeMask forced_stripes() const override { return m_forced; }
+
+    bool applies(size_t y, size_t height) const override
+    {
+        return std::apply(
+            [&](const auto&... s) { return (s.applies(y, height) || ...); },
+            m_stages);
+    }
+
+    void apply(pixel_type *stripe, size_t y, size_t height) override
+    {
+        apply_stages(stripe, y, height,
+                     std::index_sequence_for<Stages...>{});
+    }
+
+    void log_stats() const override
+    {
+        log_stages(std::index_sequence_for<Stages...>{});
+    }
+
+private:
+    static const size_t STAGE_COUNT = sizeof...(Stages);
+
+    std::tuple<Stages...> m_stages;
+    unsigned m_refresh;
+    StripeMask m_touched;
+    StripeMask m_forced;
+    std::array<uint64_t, STAGE_COUNT> m_cycles;
+    std::array<uint32_t, STAGE_COUNT> m_stripes;
+
+    bool animated_applies(size_t y, size_t height) const
+    {
+        return std::apply(
+            [&](const auto&... s) {
+                return ((s.ANIMATED && s.applies(y, height)) || ...);
+            },
+            m_stages);
+    }
+
+    template <size_t... I>
+    void apply_stages(pixel_type *stripe,
+                      size_t y,
+                      size_t height,
+                      std::index_sequence<I...>)
+    {
+        (apply_stage<I>(stripe, y, height), ...);
+    }
+
+    template <size_t I>
+    void apply_stage(pixel_type *stripe, size_t y, size_t height)
+    {
+        auto& stage = std::get<I>(m_stages);
+        if (!stage.applies(y, height)) {
+            return;
+        }
+        uint32_t before = esp_cpu_get_cycle_count();
+        stage.apply(stripe, y, height);
+        m_cycles[I] += esp_cpu_get_cycle_count() - before;
+        m_stripes[I]++;
+    }
+
+    template <size_t... I>
+    void log_stages(std::index_sequence<I...>) const
+    {
+        (log_stage<I>(), ...);
+    }
+
+    template <size_t I>
+    void log_stage() const
+    {
+        typedef std::tuple_element_t<I, std::tuple<Stages...>> Stage;
+        unsigned long mean = m_stripes[I] ? m_cycles[I] / m_stripes[I] : 0;
+        printf("StripeEffects: %-8s %8lu stripes, %6lu cycles/stripe\n",
+               Stage::NAME, (unsigned long)m_stripes[I], mean);
+    }
+};
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Stages
+
+// Now and then, shift a band of rows sideways for a few refreshes,
+// like a TV losing horizontal sync.
+class TearEffect {
+
+public:
+    static constexpr const char *NAME = "tear";
+    static const bool ANIMATED = true;
+
+    TearEffect(float chance_per_refresh, size_t max_offset);
+
+    void begin_refresh(unsigned refresh);
+    bool applies(size_t y, size_t height) const;
+    void apply(pixel_type *stripe, size_t y, size_t height);
+
+private:
+    uint32_t m_chance;
+    size_t m_max_offset;
+    size_t m_band_y;
+    size_t m_band_height;
+    size_t m_offset;
+    unsigned m_refreshes_left;
+    FastRandom m_random;
+};
+
+// A soft bright bar rolls down the screen, like a camera filming
+// a CRT.  gain is in 1/32ths: 32 is no change, 40 is 25% brighter.
+class ScanBarEffect {
+
+public:
+    static constexpr const char *NAME = "scan bar";
+    static const bool ANIMATED = true;
+
+    ScanBarEffect(unsigned period_refreshes,
+                  size_t bar_height,
+                  unsigned gain);
+
+    void begin_refresh(unsigned refresh);
+    bool applies(size_t y, size_t height) const;
+    void apply(pixel_type *stripe, size_t y, size_t height);
+
+private:
+    unsigned m_period;
+    int m_bar_height;
+    unsigned m_gain;
+    int m_bar_y;
+};
+
+// Now and then, pull the colour channels apart for a few refreshes.
+// The high channel (red in RGB565) shifts left and the low channel
+// right.
+class ChannelShiftEffect {
+
+public:
+    static constexpr const char *NAME = "chan";
+    static const bool ANIMATED = true;
+
+    ChannelShiftEffect(float chance_per_refresh, size_t max_shift);
+
+    void begin_refresh(unsigned refresh);
+    bool applies(size_t y, size_t height) const;
+    void apply(pixel_type *stripe, size_t y, size_t height);
+
+private:
+    uint32_t m_chance;
+    size_t m_max_shift;
+    size_t m_shift;
+    unsigned m_refreshes_left;
+    FastRandom m_random;
+};
+
+// Darken toward the edges.  Full brightness inside inner_radius
+// (as a fraction of half the width), falling to edge_weight/32 at
+// the edge.
+class VignetteEffect {
+
+public:
+    static constexpr const char *NAME = "vignette";
+    static const bool ANIMATED = false;
+
+    VignetteEffect(float inner_radius, unsigned edge_weight);
+
+    void begin_refresh(unsigned) {}
+    bool applies(size_t, size_t) const { return true; }
+    void apply(pixel_type *stripe, size_t y, size_t height);
+
+private:
+    // Squared distance from center, 1024 at the edge.
+    static constexpr size_t EDGE_D2 = 1024;
+    uint16_t m_d2[IMAGE_WIDTH];
+    uint8_t m_weight[2 * EDGE_D2 + 1];
+};
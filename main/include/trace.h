@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+// Trace - a timeline of what the firmware is doing
+//
+// Events go into a ring buffer in internal RAM: a microsecond
+// timestamp, the core, an event ID, whether it begins a span, ends
+// one or is an instant, and a 32 bit argument.  When the ring is
+// full the oldest events are overwritten.
+//
+// Recording takes one atomic add, a timer read and a 16 byte store,
+// and needs no lock, so it works from any task or ISR on either core
+// and can stay on in production builds.  Turn it off in the Kconfig
+// menu and every call compiles to nothing.
+//
+// Trace::dump() writes the ring to the console as base64 between
+// marker lines.  tools/trace_to_json.py turns a console log with
+// dumps in it into Chrome trace JSON, for chrome://tracing or
+// ui.perfetto.dev.
+
+enum TraceID : uint16_t {
+    TRACE_REFRESH,          // instant: refresh loop starts; refresh #
+    TRACE_SEND_STRIPE,      // instant: stripe taken; y << 16 | bytes
+    TRACE_SPI_QUEUE,        // instant: pixel transaction queued; bytes
+    TRACE_SPI_DONE,         // instant, ISR: stripe sent; frame << 16 | y
+    TRACE_SPI_WAIT,         // span: waiting for the bus; 1 if window
+    TRACE_LOAD_FRAME,       // span: Animation loads a frame; frame #
+    TRACE_STATIC_BURST,     // async span: static burst; refreshes
+
+    TRACE_ID_COUNT
+};
+
+class Trace {
+
+public:
+    enum Kind : uint8_t {
+        BEGIN,
+        END,
+        INSTANT,
+    };
+
+    // Always inline, so they're safe in IRAM ISRs.
+    __attribute__((always_inline))
+    static void begin(TraceID id, uint32_t arg = 0)
+    {
+        record(id, BEGIN, arg);
+    }
+    __attribute__((always_inline))
+    static void end(TraceID id, uint32_t arg = 0)
+    {
+        record(id, END, arg);
+    }
+    __attribute__((always_inline))
+    static void instant(TraceID id, uint32_t arg = 0)
+    {
+        record(id, INSTANT, arg);
+    }
+
+    // Write the ring to out.  Recording pauses while it's copied.
+    static void dump(FILE *out = stdout);
+
+    // Begins a span at construction and ends it at destruction.
+    class Span {
+
+    public:
+        Span(TraceID id, uint32_t arg = 0) : m_id(id) { begin(id, arg); }
+        ~Span() { end(m_id); }
+
+    private:
+        Span(const Span&) = delete;
+        void operator = (const Span&) = delete;
+
+        const TraceID m_id;
+    };
+
+private:
+#if CONFIG_TRACE_ENABLE
+
+    static const size_t EVENT_COUNT = CONFIG_TRACE_EVENTS;
+    static_assert((EVENT_COUNT & (EVENT_COUNT - 1)) == 0,
+                  "TRACE_EVENTS must be a power of two");
+
+    // seq is written first as zero and last as the event's index
+    // plus one, so dump() can tell a finished event from one that's
+    // being overwritten.
+    struct Event {
+        uint32_t seq;
+        uint32_t usec;
+        uint16_t id;
+        uint8_t kind;
+        uint8_t core;
+        uint32_t arg;
+    };
+    static_assert(sizeof (Event) == 16);
+
+    __attribute__((always_inline))
+    static void record(TraceID id, Kind kind, uint32_t arg)
+    {
+        if (s_paused.load(std::memory_order_relaxed)) {
+            return;
+        }
+        uint32_t seq = s_next.fetch_add(1, std::memory_order_relaxed);
+        Event& e = s_ring[seq & (EVENT_COUNT - 1)];
+        __atomic_store_n(&e.seq, 0, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        e.usec = esp_timer_get_time();
+        e.id = id;
+        e.kind = kind;
+        e.core = xPortGetCoreID();
+        e.arg = arg;
+        __atomic_store_n(&e.seq, seq + 1, __ATOMIC_RELEASE);
+    }
+
+    static Event s_ring[EVENT_COUNT];
+    static std::atomic<uint32_t> s_next;
+    static std::atomic<bool> s_paused;
+
+#else
+
+    __attribute__((always_inline))
+    static void record(TraceID, Kind, uint32_t) {}
+
+#endif
+};
@@ -1,32 +1,92 @@
 #pragma once
 
 #include <cstddef>
+#include "clip_codec.h"
+#include "panel_spans.h"
 #include "spi_display.h"
 
 class Animation;
 class StaticInjector;
+class StripeEffectChain;
 
 class VideoStreamer {
 
 public:
-    VideoStreamer(const Animation&, SPIDisplay&, bool inject_static);
+    // How bursts of static are drawn.
+    enum StaticEffect {
+        NO_STATIC,
+
+        // Static replaces the image stripe.
+        STATIC_STRIPES,
+
+        // Static is added to the image stripe, ramping in and out.
+        STATIC_OVERLAY,
+    };
+
+    // With crossfade, stripes that change in the next video frame
+    // fade into it one refresh at a time.  It needs the next frame
+    // ahead of time, so it only works when frames load in a task.
+    // static_bank_bytes is passed to StaticInjector.  With
+    // round_clip on a round display, only the part of each stripe
+    // the panel shows is sent.  effects may be null.
+    // The animation is told which transactions read its frame
+    // buffers, so it doesn't reuse one the display is still reading.
+    VideoStreamer(Animation&,
+                  SPIDisplay&,
+                  StaticEffect,
+                  size_t static_bank_bytes,
+                  bool crossfade,
+                  bool round_clip,
+                  StripeEffectChain *effects);
     ~VideoStreamer();
 
+    // While the panel can't be seen, update() sends nothing.  When
+    // it's visible again, every stripe is sent.
+    void set_visible(bool visible) { m_visible = visible; }
+
     void update();
 
 private:
     VideoStreamer(const VideoStreamer&) = delete;
     void operator = (const VideoStreamer&) = delete;    
 
-    const Animation& m_source;
+    Animation& m_source;
     StaticInjector *m_static_source;
     SPIDisplay& m_display;
-    const bool m_inject_static;
+    const StaticEffect m_static_effect;
+    const bool m_crossfade;
+    StripeEffectChain *m_effects;
+    const PanelSpans m_spans;
     TransactionID m_last_trans;
+    bool m_visible;
+
+    // The display keeps its pixels, so we only send image stripes
+    // that changed in the video or were covered by static.
+    StripeMask m_dirty_stripes;
+    unsigned m_frame_serial;
 
-    static size_t s_static_rotor;
+    // A small pool of DMA-capable stripe buffers for static and
+    // for streamed image stripes.
+    static const size_t STRIPE_BUFFER_COUNT = 6;
+    static size_t s_stripe_rotor;
+    static TransactionID s_stripe_buffer_trans[STRIPE_BUFFER_COUNT];
+    static pixel_type s_stripe_buffers[STRIPE_BUFFER_COUNT]
+                                      [SPIDisplay::STRIPE_HEIGHT]
+                                      [IMAGE_WIDTH];
 
+    size_t claim_stripe_buffer();
+    void apply_effects(pixel_type *stripe, size_t y, size_t height);
+    TransactionID send_bounced_stripe(size_t y,
+                                      size_t height,
+                                      pixel_type *stripe,
+                                      const pixel_type *source);
     void fill_with_black();
     void send_image_stripe(size_t y, size_t height);
     void send_static_stripe(size_t y, size_t height);
+    void send_noisy_stripe(size_t y, size_t height, unsigned intensity);
+    void send_dissolved_stripe(size_t y, size_t height, unsigned weight);
+    void send_blended_stripe(size_t y,
+                             size_t height,
+                             const image_type *next,
+                             unsigned weight);
 };
@@ -2,19 +2,32 @@
 #include <cmath>
 #include <cstdio>
 #include <cstring>
+#include <iterator>
 #include <numbers>
 
+// ESP-IDF headers
+#include "sdkconfig.h"
+
 // Component headers
 #include "animation.h"
 #include "battery_monitor.h"
 #include "board_defs.h"
+#include "clip_cache.h"
 #include "refresh_clock.h"
 #include "driver_backlight.h"
 #include "driver_buzzer.h"
 #include "flicker_effect.h"
+#include "frame_profiler.h"
+#include "playlist.h"
+#include "random.h"
 #include "spi_display.h"
+#include "stripe_effects.h"
+#include "trace.h"
 #include "video_streamer.h"
 
+#ifdef CONFIG_IDF_TARGET_LINUX
+    #include "host_main.h"
+#endif
 
 // //  //   //    //     //      //       //      //     //    //   //  // //
 // App Level Settings
@@ -22,12 +35,83 @@
 // Enable to make the backlight slowly flicker
 static const bool ENABLE_FLICKER_EFFECT = true;
 
-// Enable to inject static bursts into the video
-static const bool ENABLE_STATIC_EFFECT = true;
+// Enable to stop sending video while the flickering backlight is
+// off.  The clip pauses, and a whole frame is sent this many
+// refreshes before the light comes back.
+static const bool ENABLE_DARK_SKIP = true;
+static const unsigned DARK_WAKE_REFRESHES = 2;
+
+// How to inject static bursts into the video
+//   NO_STATIC      - don't.
+//   STATIC_STRIPES - replace stripes of the image with static.
+//   STATIC_OVERLAY - add static to the image, ramping in and out.
+static const VideoStreamer::StaticEffect STATIC_EFFECT =
+    VideoStreamer::STATIC_STRIPES;
+
+// Serve static from this much noise made at startup instead of
+// generating it for every stripe.  Each row is a random row of the
+// bank, shifted and tinted, so it doesn't visibly repeat.  Zero
+// generates fresh noise.
+static const size_t STATIC_BANK_BYTES = 32 * 1024;
+
+// Enable to apply Effects to each stripe on its way to the screen.
+static const bool ENABLE_STRIPE_EFFECTS = false;
+
+// The stripe effects, in order.  Stages left out of the list aren't
+// compiled in.  The stages are
+//   TearEffect, ScanBarEffect, ChannelShiftEffect, VignetteEffect.
+// Their settings are where the_effects is created, below.
+typedef StripeEffects<TearEffect, ScanBarEffect, ChannelShiftEffect>
+    Effects;
+
+// Enable to fade between video frames at the screen refresh rate
+// instead of stepping.  Needs LOAD_IN_TASK.
+static const bool ENABLE_CROSSFADE = false;
+
+// On a round panel, send only the part of each stripe inside the
+// circle.  Saves about a fifth of the SPI bytes on a GC9A01.
+static const bool ENABLE_ROUND_CLIPPING = true;
+
+// How video frames are loaded from flash.
+//   LOAD_INLINE    - in the refresh loop, when a frame is due.  Slow.
+//   LOAD_IN_TASK   - ahead of time, in a task on the other core.
+//   STREAM_STRIPES - decode each stripe just before it's sent instead
+//                    of double buffering whole frames.  Saves ~200 KB
+//                    of internal RAM.
+static const Animation::FrameLoading FRAME_LOADING = Animation::LOAD_IN_TASK;
+
+// When the soul changes, the new one dissolves in over this long.
+// Zero cuts straight to it.
+static constexpr float DISSOLVE_SEC = 1.0f;
+
+// Copy the playing clip into this much PSRAM and play it from there.
+// Zero disables the cache.  Whatever doesn't fit plays from flash.
+static const size_t CLIP_CACHE_BYTES = 1536 * 1024;
+
+// Seed for every random choice.  Zero seeds from the hardware RNG.
+// The seed is logged at boot; set it here to replay that session.
+static const uint64_t RANDOM_SEED = 0;
 
 // Screen refresh rate
 static constexpr float SCREEN_REFRESH_HZ = 60.0f;
 
+// Time each part of the refresh loop, and log where the time went
+// this often.  Disabled, the profiler compiles to nothing.
+static const bool ENABLE_LOOP_PROFILER = true;
+static const unsigned LOOP_PROFILE_LOG_PERIOD_SEC = 60;
+
+// Headless benchmark.  Run this many refreshes back to back instead
+// of on the refresh clock, print the loop profile, and return.  The
+// profile is kept even if ENABLE_LOOP_PROFILER is off.  Zero runs
+// forever.  The host build takes the count from its command line
+// instead.
+static const unsigned BENCHMARK_REFRESHES = 0;
+
+// Write the trace ring to the console once, this long after boot.
+// tools/trace_to_json.py turns the log into a timeline.  Zero never
+// dumps.  Tracing itself is in the Kconfig menu.
+static const unsigned TRACE_DUMP_AFTER_SEC = 0;
+
 // How often to log battery voltage to serial port
 static const int BATTERY_LOG_PERIOD_SEC = 10;
 
@@ -41,6 +125,37 @@ static const unsigned ANIM_FRAMES = 70 * SCREEN_REFRESH_HZ; // 70 seconds
 // choose to change the displayed soul.
 static constexpr float SOUL_CHANGE_PROBABILITY = 0.7;
 
+// Which clip plays when.  Clips are named by partition label.
+// The intro plays first, then one of the souls.  At the end of
+// each flicker loop, the souls might swap.
+static const Playlist::Rule PLAYLIST[] = {
+    // clip      at clip end            at flicker loop end
+    { "Intro",  { "soul_f", "soul_m" }, {},           0.0f },
+    { "soul_f", {},                     { "soul_m" }, SOUL_CHANGE_PROBABILITY },
+    { "soul_m", {},                     { "soul_f" }, SOUL_CHANGE_PROBABILITY },
+};
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Loop Profiling
+
+// The parts of the refresh loop, timed separately.  Only this task's
+// time is counted; the frame loader and clip cache tasks run on the
+// other core.
+enum LoopPhase {
+    PHASE_FLICKER,
+    PHASE_STREAMER,
+    PHASE_BATTERY,
+    PHASE_ANIMATION,
+    PHASE_COUNT
+};
+
+static const char *const PHASE_NAMES[PHASE_COUNT] = {
+    "flicker", "streamer", "battery", "animation",
+};
+
+typedef FrameProfiler<PHASE_COUNT, ENABLE_LOOP_PROFILER> LoopProfiler;
+
 
 // //  //   //    //     //      //       //      //     //    //   //  // //
 // App Main Task
@@ -50,19 +165,39 @@ extern "C" void app_main()
     printf("app_main\n");
     printf("board = \"%s\"\n", board_name);
 
+    set_random_session_seed(RANDOM_SEED);
+
     // Create the world.
     // create and blank the screen before turning on the backlight.
     Buzzer the_buzzer;
     BatteryMonitor the_battery(BATTERY_LOG_PERIOD_SEC);
 
-    Animation the_animation(ANIM_FRAMES, SOUL_CHANGE_PROBABILITY);
+    Playlist the_playlist(PLAYLIST, std::size(PLAYLIST));
+    ClipCache the_clip_cache(CLIP_CACHE_BYTES);
+
+    Animation the_animation(
+        ANIM_FRAMES,
+        the_playlist,
+        the_clip_cache,
+        SCREEN_REFRESH_HZ,
+        FRAME_LOADING,
+        DISSOLVE_SEC);
 
     SPIDisplay the_display;
 
+    Effects the_effects(
+        TearEffect(0.004f, 24),                     // chance/refresh, pixels
+        ScanBarEffect(5 * SCREEN_REFRESH_HZ, 32, 38), // period, rows, gain
+        ChannelShiftEffect(0.002f, 3));             // chance/refresh, pixels
+
     VideoStreamer the_streamer(
         the_animation,
         the_display,
-        ENABLE_STATIC_EFFECT);
+        STATIC_EFFECT,
+        STATIC_BANK_BYTES,
+        ENABLE_CROSSFADE,
+        ENABLE_ROUND_CLIPPING,
+        ENABLE_STRIPE_EFFECTS ? &the_effects : nullptr);
 
     Backlight the_backlight(ENABLE_FLICKER_EFFECT ? 0.0f : 1.0f);
 
@@ -71,13 +206,64 @@ extern "C" void app_main()
         ANIM_FRAMES,
         ENABLE_FLICKER_EFFECT);
 
+    bool skip_dark = ENABLE_DARK_SKIP;
+    uint32_t refresh_count = 0;
+    auto refresh = [&](auto& profiler) {
+        Trace::instant(TRACE_REFRESH, refresh_count++);
+        {
+            auto t = profiler.time(PHASE_FLICKER);
+            the_spooky_flicker_effect.update();
+            unsigned dark = the_spooky_flicker_effect.dark_refreshes();
+            bool visible = !skip_dark || dark <= DARK_WAKE_REFRESHES;
+            the_streamer.set_visible(visible);
+            the_animation.set_visible(visible);
+        }
+        {
+            auto t = profiler.time(PHASE_STREAMER);
+            the_streamer.update();
+        }
+        {
+            auto t = profiler.time(PHASE_BATTERY);
+            the_battery.update();
+        }
+        {
+            // Do this last, in case loading is inline
+            auto t = profiler.time(PHASE_ANIMATION);
+            the_animation.update();
+        }
+        profiler.end_refresh();
+    };
+
+    unsigned benchmark_refreshes = BENCHMARK_REFRESHES;
+#ifdef CONFIG_IDF_TARGET_LINUX
+    benchmark_refreshes = host_benchmark_refreshes();
+#endif
+    if (benchmark_refreshes) {
+        // Time the loop's real work, not the dark stretches.
+        skip_dark = false;
+        FrameProfiler<PHASE_COUNT> profiler(PHASE_NAMES, SCREEN_REFRESH_HZ, 0);
+        for (unsigned i = 0; i < benchmark_refreshes; i++) {
+            refresh(profiler);
+        }
+        profiler.log_stats();
+        return;
+    }
+
+    LoopProfiler the_profiler(
+        PHASE_NAMES,
+        SCREEN_REFRESH_HZ,
+        LOOP_PROFILE_LOG_PERIOD_SEC * SCREEN_REFRESH_HZ);
+
     RefreshClock the_refresh_clock(SCREEN_REFRESH_HZ);
 
+    const uint32_t trace_dump_refresh =
+        TRACE_DUMP_AFTER_SEC * SCREEN_REFRESH_HZ;
+
     while (1) {
         the_refresh_clock.wait();
-        the_spooky_flicker_effect.update();
-        the_streamer.update();
-        the_battery.update();
-        the_animation.update(); // Do this last, every 8th frame is slow
+        refresh(the_profiler);
+        if (trace_dump_refresh && refresh_count == trace_dump_refresh) {
+            Trace::dump();
+        }
     }
 }
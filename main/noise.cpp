@@ -0,0 +1,219 @@
+// This file's header
+#include "noise.h"
+
+// C++ standard headers
+#include <cassert>
+
+#ifdef ESP_PLATFORM
+    #include "sdkconfig.h"
+#endif
+
+NoiseGenerator::NoiseGenerator(uint32_t seed)
+{
+    // splitmix32 spreads one seed over the lanes.  xorshift
+    // is stuck at zero, so avoid it.
+    for (auto& state : m_state) {
+        uint32_t z = (seed += 0x9E3779B9);
+        z = (z ^ z >> 16) * 0x85EBCA6B;
+        z = (z ^ z >> 13) * 0xC2B2AE35;
+        z ^= z >> 16;
+        state = z ? z : 1;
+    }
+}
+
+// Two grey pixels from 32 random bits, one per 16 bit lane.
+static inline uint32_t grey565_pair(uint32_t x)
+{
+    uint32_t g6 = x & 0x003F003F;
+    uint32_t rb5 = g6 >> 1 & 0x001F001F;
+    return rb5 << 11 | g6 << 5 | rb5;
+}
+
+void NoiseGenerator::fill_565_reference(void *dest,
+                                        size_t pixel_count,
+                                        PixelEndian endian)
+{
+    assert(pixel_count % NOISE_PIXEL_MULTIPLE == 0);
+    auto *d = (uint8_t *)dest;
+    for (size_t i = 0; i < pixel_count; i += 2 * LANES) {
+        for (size_t lane = 0; lane < LANES; lane++) {
+            uint32_t x = m_state[lane];
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            m_state[lane] = x;
+
+            uint32_t pair = grey565_pair(x);
+            if (endian == PixelEndian::BIG) {
+                pair = (pair >> 8 & 0x00FF00FF) | (pair << 8 & 0xFF00FF00);
+            }
+            d[0] = pair >> 0;
+            d[1] = pair >> 8;
+            d[2] = pair >> 16;
+            d[3] = pair >> 24;
+            d += 4;
+        }
+    }
+}
+
+#if CONFIG_IDF_TARGET_ESP32S3
+
+// Eight pixels per loop.  PIE's 32 bit shifts are arithmetic and
+// shift by SAR, so every right shift is masked.
+//
+//   q0             xorshift state, four lanes
+//   q1             0x00007FFF in each 32 bit lane
+//   q2, q3, q4     0x003F, 0x001F, 0x00FF in each 16 bit lane
+//   q5, q6, q7     scratch; q7 is the output
+static void
+__attribute__((noinline))
+asm_noise_be(void *dest, uint32_t *state, size_t chunk_count,
+             const uint32_t *constants)
+{
+    uint32_t tmp;
+    uint32_t *state_out = state;
+
+    asm volatile (
+
+        "    ee.vld.128.ip q0, %[s], 0       \n"
+        "    ee.vldbc.32.ip q1, %[k], 4      \n"
+        "    ee.vldbc.16.ip q2, %[k], 4      \n"
+        "    ee.vldbc.16.ip q3, %[k], 4      \n"
+        "    ee.vldbc.16 q4, %[k]            \n"
+
+        "loop%=:                             \n"
+
+        // xorshift32: x ^= x << 13; x ^= x >> 17; x ^= x << 5
+        "    movi %[t], 13                   \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsl.32 q5, q0                \n"
+        "    ee.xorq q0, q0, q5              \n"
+        "    movi %[t], 17                   \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsr.32 q5, q0                \n"
+        "    ee.andq q5, q5, q1              \n"
+        "    ee.xorq q0, q0, q5              \n"
+        "    movi %[t], 5                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsl.32 q5, q0                \n"
+        "    ee.xorq q0, q0, q5              \n"
+
+        // grey565: rb5 << 11 | g6 << 5 | rb5.  SAR is still 5.
+        "    ee.andq q5, q0, q2              \n"
+        "    ee.vsl.32 q7, q5                \n"
+        "    movi %[t], 1                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsr.32 q6, q5                \n"
+        "    ee.andq q6, q6, q3              \n"
+        "    ee.orq q7, q7, q6               \n"
+        "    movi %[t], 11                   \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsl.32 q6, q6                \n"
+        "    ee.orq q7, q7, q6               \n"
+
+        // Byte swap to big endian.
+        "    movi %[t], 8                    \n"
+        "    wsr.sar %[t]                    \n"
+        "    ee.vsr.32 q5, q7                \n"
+        "    ee.andq q5, q5, q4              \n"
+        "    ee.vsl.32 q6, q7                \n"
+        "    ee.andq q7, q6, q4              \n"
+        "    ee.xorq q6, q6, q7              \n"
+        "    ee.orq q7, q5, q6               \n"
+        "    ee.vst.128.ip q7, %[d], 16      \n"
+
+        "    addi.n %[n], %[n], -1           \n"
+        "    bnez %[n], loop%=               \n"
+
+        "    ee.vst.128.ip q0, %[so], 0        "
+
+        : [d] "+r" (dest),
+          [s] "+r" (state),
+          [so] "+r" (state_out),
+          [n] "+r" (chunk_count),
+          [k] "+r" (constants),
+          [t] "=&r" (tmp)
+
+        :
+
+        : "memory"
+    );
+}
+
+#endif /* CONFIG_IDF_TARGET_ESP32S3 */
+
+void NoiseGenerator::fill_565(void *dest,
+                              size_t pixel_count,
+                              PixelEndian endian)
+{
+    const size_t DSP_ALIGN_MASK = DSP_ALIGNMENT - 1;
+
+    assert(((intptr_t)dest & DSP_ALIGN_MASK) == 0);
+    assert(pixel_count % NOISE_PIXEL_MULTIPLE == 0);
+
+#if CONFIG_IDF_TARGET_ESP32S3
+    if (endian == PixelEndian::BIG && pixel_count) {
+        // Masks, in the order the kernel loads them.
+        static const uint32_t constants[4] DSP_ALIGNED_ATTR = {
+            0x00007FFF, 0x0000003F, 0x0000001F, 0x000000FF,
+        };
+        size_t chunk_count = pixel_count / NOISE_PIXEL_MULTIPLE;
+        asm_noise_be(dest, m_state, chunk_count, constants);
+        return;
+    }
+#endif
+
+    fill_565_reference(dest, pixel_count, endian);
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Noise Bank
+
+NoiseBank::NoiseBank(void *storage,
+                     size_t storage_bytes,
+                     size_t row_pixels,
+                     PixelEndian endian,
+                     uint32_t seed)
+: m_rows((const uint32_t *)storage),
+  m_row_words(row_pixels / 2),
+  m_row_count(storage_bytes / (row_pixels * 2)),
+  m_endian(endian),
+  m_pick(seed | 1)
+{
+    assert(row_pixels % NOISE_PIXEL_MULTIPLE == 0);
+    assert(m_row_count > 0);
+    NoiseGenerator gen(seed);
+    gen.fill_565(storage, m_row_count * row_pixels, endian);
+}
+
+void NoiseBank::fill_565(void *dest, size_t row_count)
+{
+    auto *d = (uint32_t *)dest;
+    for (size_t row = 0; row < row_count; row++) {
+        uint32_t x = m_pick;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        m_pick = x;
+
+        // Low bits pick the grey, middle bits the rotation and high
+        // bits the row.  randint-style modulo bias doesn't show.
+        uint32_t g6 = x & 0x3F;
+        uint32_t mask = grey565_pair(g6 << 16 | g6);
+        if (m_endian == PixelEndian::BIG) {
+            mask = (mask >> 8 & 0x00FF00FF) | (mask << 8 & 0xFF00FF00);
+        }
+        size_t start = (x >> 6 & 0x3FF) % m_row_words;
+        const uint32_t *src = m_rows + (x >> 16) % m_row_count * m_row_words;
+
+        size_t i = 0;
+        for (size_t j = start; j < m_row_words; j++) {
+            d[i++] = src[j] ^ mask;
+        }
+        for (size_t j = 0; j < start; j++) {
+            d[i++] = src[j] ^ mask;
+        }
+        d += m_row_words;
+    }
+}
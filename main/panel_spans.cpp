@@ -0,0 +1,98 @@
+// This file's header
+#include "panel_spans.h"
+
+// C++ standard headers
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// Work in half pixels so the circle's center is on the grid.
+// Pixel x covers [2x, 2x + 2].  Its distance from center c is 0 if
+// it straddles c, or the distance to its nearer edge.
+static size_t half_pixel_distance(size_t x, size_t c)
+{
+    size_t lo = 2 * x, hi = 2 * x + 2;
+    if (hi <= c) {
+        return c - hi;
+    }
+    if (lo >= c) {
+        return lo - c;
+    }
+    return 0;
+}
+
+PanelSpans::PanelSpans(size_t panel_width,
+                       size_t panel_height,
+                       bool round,
+                       size_t image_width,
+                       size_t image_height)
+: m_image_width(image_width),
+  m_rows(image_height)
+{
+    assert(image_width <= panel_width && image_height <= panel_height);
+    assert(image_width <= UINT16_MAX);
+    size_t x_offset = (panel_width - image_width) / 2;
+    size_t y_offset = (panel_height - image_height) / 2;
+
+    // Centre and diameter, in half pixels.
+    size_t cx = panel_width;
+    size_t cy = panel_height;
+    size_t d = std::min(panel_width, panel_height);
+
+    for (size_t y = 0; y < image_height; y++) {
+        Span& span = m_rows[y];
+        if (!round) {
+            span = { 0, (uint16_t)image_width };
+            continue;
+        }
+        size_t dy = half_pixel_distance(y + y_offset, cy);
+        size_t x0 = image_width, x1 = 0;
+        for (size_t x = 0; x < image_width; x++) {
+            size_t dx = half_pixel_distance(x + x_offset, cx);
+            if (dx * dx + dy * dy < d * d) {
+                x0 = std::min(x0, x);
+                x1 = x + 1;
+            }
+        }
+        span = x0 < x1 ? Span{ (uint16_t)x0, (uint16_t)x1 } : Span{ 0, 0 };
+    }
+}
+
+PanelSpans::Span PanelSpans::stripe(size_t y, size_t height) const
+{
+    assert(y + height <= m_rows.size());
+    Span s = { (uint16_t)m_image_width, 0 };
+    for (size_t row = y; row < y + height; row++) {
+        Span r = m_rows[row];
+        if (r.x0 < r.x1) {
+            s.x0 = std::min(s.x0, r.x0);
+            s.x1 = std::max(s.x1, r.x1);
+        }
+    }
+    // A stripe that shows nothing goes out whole.
+    if (s.x0 >= s.x1) {
+        s = { 0, (uint16_t)m_image_width };
+    }
+    return s;
+}
+
+PanelSpans::Span PanelSpans::gather(void *dest,
+                                    const void *src,
+                                    size_t y,
+                                    size_t height,
+                                    size_t pixel_size) const
+{
+    Span s = stripe(y, height);
+    auto *d = (uint8_t *)dest;
+    auto *p = (const uint8_t *)src;
+    size_t row_bytes = m_image_width * pixel_size;
+    size_t span_bytes = s.width() * pixel_size;
+    // Rows move down in memory or stay put, so memmove
+    // row by row is safe in place.
+    for (size_t row = 0; row < height; row++) {
+        std::memmove(d + row * span_bytes,
+                     p + row * row_bytes + s.x0 * pixel_size,
+                     span_bytes);
+    }
+    return s;
+}
@@ -0,0 +1,96 @@
+// This file's header
+#include "playlist.h"
+
+// C++ standard headers
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+
+// Component headers
+#include "flash_image.h"
+
+Playlist::Playlist(const Rule *rules, size_t rule_count)
+: m_scene_count(rule_count),
+  m_scenes(new Scene[rule_count])
+{
+    // Find the clips first so that rules can't lead to missing ones.
+    for (size_t i = 0; i < m_scene_count; i++) {
+        Scene& scene = m_scenes[i];
+        scene.clip = FlashImage::get_by_label(rules[i].clip);
+        if (!scene.clip) {
+            printf("Playlist: no clip \"%s\"\n", rules[i].clip);
+        }
+    }
+    assert(m_scene_count > 0 && m_scenes[0].clip);
+
+    for (size_t i = 0; i < m_scene_count; i++) {
+        Scene& scene = m_scenes[i];
+        resolve(rules[i].on_end, scene.on_end);
+        resolve(rules[i].on_flicker_loop, scene.on_flicker_loop);
+        scene.flicker_loop_probability = rules[i].flicker_loop_probability;
+    }
+
+    for (size_t i = 0; i < FlashImage::count(); i++) {
+        const char *label = FlashImage::get_by_index(i)->label();
+        if (find_scene(label) == NO_SCENE) {
+            printf("Playlist: clip \"%s\" is never played\n", label);
+        }
+    }
+}
+
+Playlist::~Playlist()
+{
+    delete [] m_scenes;
+}
+
+size_t Playlist::after_end(size_t scene, uint32_t roll) const
+{
+    assert(scene < m_scene_count);
+    const Choices& choices = m_scenes[scene].on_end;
+    if (choices.count == 0) {
+        return scene;
+    }
+    return choose(choices, roll);
+}
+
+size_t Playlist::after_flicker_loop(size_t scene,
+                                    float chance,
+                                    uint32_t roll) const
+{
+    assert(scene < m_scene_count);
+    const Scene& s = m_scenes[scene];
+    if (s.on_flicker_loop.count == 0 ||
+        chance >= s.flicker_loop_probability) {
+        return NO_SCENE;
+    }
+    return choose(s.on_flicker_loop, roll);
+}
+
+size_t Playlist::find_scene(const char *label) const
+{
+    for (size_t i = 0; i < m_scene_count; i++) {
+        const FlashImage *clip = m_scenes[i].clip;
+        if (clip && !std::strcmp(label, clip->label())) {
+            return i;
+        }
+    }
+    return NO_SCENE;
+}
+
+void Playlist::resolve(const char *const *labels, Choices& choices) const
+{
+    choices.count = 0;
+    for (size_t i = 0; i < MAX_CHOICES && labels[i]; i++) {
+        size_t scene = find_scene(labels[i]);
+        if (scene == NO_SCENE) {
+            printf("Playlist: no scene \"%s\"\n", labels[i]);
+            continue;
+        }
+        choices.scenes[choices.count++] = scene;
+    }
+}
+
+size_t Playlist::choose(const Choices& choices, uint32_t roll)
+{
+    return choices.scenes[roll % choices.count];
+}
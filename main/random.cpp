@@ -1,24 +1,38 @@
 // This file's header
 #include "random.h"
 
+// C++ standard headers
+#include <cstdio>
+
 // ESP-IDF headers
 #include "bootloader_random.h"
 #include "esp_random.h"
 
-Random Random::s_instance;
+static uint64_t s_session_seed;
 
-Random::Random()
+void set_random_session_seed(uint64_t seed)
 {
-    bootloader_random_enable();
+    s_session_seed = seed;
 }
 
-unsigned Random::o_rand()
+uint64_t random_session_seed()
 {
-    static bool been_here;
-    if (!been_here) {
-        been_here = true;
-        std::srand(esp_random());
+    if (s_session_seed == 0) {
+        // Without the radio, esp_random() needs the bootloader's
+        // entropy source to be truly random.
+        bootloader_random_enable();
+        uint64_t hi = esp_random();
+        s_session_seed = hi << 32 | esp_random();
         bootloader_random_disable();
     }
-    return std::rand();
+    if (s_session_seed == 0) {
+        s_session_seed = 1;
+    }
+    static bool logged;
+    if (!logged) {
+        logged = true;
+        printf("Random: session seed 0x%016llx\n",
+               (unsigned long long)s_session_seed);
+    }
+    return s_session_seed;
 }
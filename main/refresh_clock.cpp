@@ -1,91 +1,138 @@
 // This file's header
 #include "refresh_clock.h"
 
+// C++ standard headers
+#include <cassert>
+#include <cinttypes>
+#include <cstdio>
+
 // ESP-IDF headers
+#include "esp_err.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 
-// Project headers
-#include "sdkconfig.h"
+// Component headers
+#include "duration_histogram.h"
 
 struct RefreshClock_private {
-    TimerHandle_t timer;
+    esp_timer_handle_t timer;
     TaskHandle_t task;
 
-    // ticks_heuristic - find the whole number of ticks with the smallest error.
-    TickType_t ticks_heuristic(float target_freq_hz)
+    int64_t start_usec;
+    uint64_t period_nsec;
+    uint64_t fired;             // deadlines the timer has passed
+    uint64_t taken;             // deadlines wait() has returned for
+    int64_t woke_usec;          // when wait() last returned
+
+    unsigned log_periods;
+    uint32_t missed;
+    DurationHistogram latency;
+    DurationHistogram loop;
+
+    // Deadline n is n periods after start.  Computing each one from
+    // the start keeps fractional microseconds from adding up.
+    int64_t deadline_usec(uint64_t n) const
     {
-        // fast_ticks: round down for a faster clock
-        // slow_ticks: round up for a slower clock
-        float sys_freq = (float)CONFIG_FREERTOS_HZ;
-        TickType_t fast_ticks = (TickType_t)(sys_freq / target_freq_hz);
-        float fast_freq = sys_freq / fast_ticks;
-        float fast_error = fast_freq / sys_freq; // >= 1.0
-        TickType_t slow_ticks = fast_ticks + 1;
-        float slow_freq = sys_freq / slow_ticks;
-        float slow_error = sys_freq / slow_freq;
-
-        // printf("Ticks Heuristic:\n");
-        // printf("    target_freq = %g\n", target_freq_hz);
-        // printf("    sys_freq    = %g\n", sys_freq);
-        // printf("    fast_ticks  = %" PRIu32 "\n", fast_ticks);
-        // printf("    slow_ticks  = %" PRIu32 "\n", slow_ticks);
-        // printf("    fast_error  = %g\n", fast_error);
-        // printf("    slow_error  = %g\n", slow_error);
-        
-        // Choose fast or slow to minimize error
-        TickType_t ticks;
-        float freq;
-        if (fast_error < slow_error) {
-            // printf("using fast\n");
-            ticks = fast_ticks;
-            freq = fast_freq;
-        } else {
-            // printf("using slow\n");
-            ticks = slow_ticks;
-            freq = slow_freq;
-        }
+        return start_usec + (int64_t)(n * period_nsec / 1000);
+    }
 
-        // Print warning if chosen frequency isn't exact
-        if (freq != target_freq_hz) {
-            printf("RefreshClock: "
-                   "approximating %g Hz using %" PRIu32 " ticks = %g Hz\n",
-                   target_freq_hz, ticks, freq);
-        }
-        return ticks;
+    void arm_next()
+    {
+        int64_t delay = deadline_usec(fired + 1) - esp_timer_get_time();
+        ESP_ERROR_CHECK(esp_timer_start_once(timer, delay > 0 ? delay : 1));
     }
 };
 
-static void timer_callback(TimerHandle_t handle)
+// This runs in the esp_timer task, which outranks app tasks.
+static void timer_callback(void *arg)
 {
-    auto *priv = (RefreshClock_private *)pvTimerGetTimerID(handle);
+    auto *priv = (RefreshClock_private *)arg;
     assert(priv);
 
-    BaseType_t higher_priority_task_woken = pdFALSE;
-    vTaskNotifyGiveFromISR(priv->task, &higher_priority_task_woken);
-    // return higher_priority_task_woken == pdTRUE;
+    priv->fired++;
+    xTaskNotifyGive(priv->task);
+    priv->arm_next();
 }
 
 RefreshClock::RefreshClock(float freq_hz)
 {
     m_private = new RefreshClock_private;
     assert(m_private);
+    auto *priv = m_private;
 
-    TickType_t period = m_private->ticks_heuristic(freq_hz);
+    priv->task = xTaskGetCurrentTaskHandle();
+    priv->period_nsec = (uint64_t)(1e9 / freq_hz + 0.5);
+    priv->fired = 0;
+    priv->taken = 0;
+    priv->woke_usec = 0;
+    priv->log_periods = (unsigned)(LOG_PERIOD_SEC * freq_hz + 0.5f);
+    priv->missed = 0;
 
-    const char *timer_name = "refresh_clock";
-    BaseType_t auto_reload = pdTRUE;
-    void *timer_ID = (void *)m_private;
-    m_private->timer =
-        xTimerCreate(timer_name, period, auto_reload, timer_ID, timer_callback);    
+    esp_timer_create_args_t args = {};
+    args.callback = timer_callback;
+    args.arg = priv;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "refresh_clock";
+    ESP_ERROR_CHECK(esp_timer_create(&args, &priv->timer));
 
-    m_private->task = xTaskGetCurrentTaskHandle();
+    priv->start_usec = esp_timer_get_time();
+    priv->arm_next();
+}
 
-    xTimerStart(m_private->timer, period);
+RefreshClock::~RefreshClock()
+{
+    esp_timer_stop(m_private->timer);
+    ESP_ERROR_CHECK(esp_timer_delete(m_private->timer));
+    delete m_private;
 }
 
 void RefreshClock::wait()
 {
+    auto *priv = m_private;
+
+    // The loop body ran from the last wakeup until now.  If the next
+    // deadline is already behind us, the loop missed it.
+    int64_t now = esp_timer_get_time();
+    if (priv->taken) {
+        priv->loop.add(now - priv->woke_usec);
+        if (now > priv->deadline_usec(priv->taken + 1)) {
+            priv->missed++;
+        }
+    }
+
+    // Each deadline is served once, so a late loop catches up.
     BaseType_t clear_count = pdFALSE;
     TickType_t timeout = portMAX_DELAY;
     (void)ulTaskNotifyTake(clear_count, timeout);
-}
\ No newline at end of file
+
+    priv->taken++;
+    priv->woke_usec = esp_timer_get_time();
+    priv->latency.add(priv->woke_usec - priv->deadline_usec(priv->taken));
+
+    if (priv->latency.count() >= priv->log_periods) {
+        log_stats();
+        priv->latency.reset();
+        priv->loop.reset();
+        priv->missed = 0;
+    }
+}
+
+static void log_histogram(const char *name, const DurationHistogram& h)
+{
+    printf("RefreshClock: %-12s %6" PRIu32 " %6" PRIu32 " %6" PRIu32
+           " %6" PRIu32 "\n",
+           name, h.min(), h.mean(), h.percentile(99), h.max());
+}
+
+void RefreshClock::log_stats() const
+{
+    const auto *priv = m_private;
+    printf("RefreshClock: %" PRIu32 " periods of %.1f usec, "
+           "%" PRIu32 " missed deadlines\n",
+           priv->latency.count(),
+           priv->period_nsec / 1000.0,
+           priv->missed);
+    printf("RefreshClock: usec            min   mean    p99    max\n");
+    log_histogram("wake latency", priv->latency);
+    log_histogram("loop", priv->loop);
+}
@@ -2,17 +2,27 @@
 #include "spi_display.h"
 
 // C++ standard headers
+#include <atomic>
 #include <cassert>
 #include <climits>
+#include <cstdint>
 #include <cstring>
 
 // ESP-IDF headers
 #include "driver/spi_master.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 // Component headers
 #include "board_defs.h"
 #include "display_controllers.h"
 #include "driver_display.h"
+#include "trace.h"
+
+// The transaction pool, below.
+static void init_transactions();
+static void transaction_post_cb(spi_transaction_t *trans_desc);
 
 SPIDisplay::SPIDisplay()
 : m_display_height(DISPLAY_HEIGHT),
@@ -20,10 +30,20 @@ SPIDisplay::SPIDisplay()
   m_in_frame(false),
   m_frame_ready(false),
   m_frame(0),
-  m_current_y(0)
+  m_current_y(0),
+  m_window_x0(0),
+  m_window_x1(0),
+  m_max_in_flight(TRANSACTION_POOL_SIZE < SPI_QUEUE_DEPTH
+                  ? TRANSACTION_POOL_SIZE
+                  : SPI_QUEUE_DEPTH),
+  m_max_transaction_bytes(MAX_TRANSACTION_BYTES),
+  m_transaction_count(0),
+  m_pending(nullptr),
+  m_pending_data(nullptr),
+  m_pending_bytes(0)
 {
     size_t stripe_size = STRIPE_HEIGHT * m_display_width * sizeof (pixel_type);
-    assert(stripe_size <= SPI_MAX_DMA_LEN);
+    assert(stripe_size <= MAX_TRANSACTION_BYTES);
 
     SPIDisplayDesc desc = {
         .height = m_display_height,
@@ -38,7 +58,12 @@ SPIDisplay::SPIDisplay()
         .cs_gpio = DISPLAY_CS_GPIO,
         .dc_gpio = DISPLAY_DC_GPIO,
         .reset_gpio = DISPLAY_RESET_GPIO,
+
+        .queue_size = SPI_QUEUE_DEPTH,
+        .max_transaction_bytes = MAX_TRANSACTION_BYTES,
+        .post_cb = transaction_post_cb,
     };
+    init_transactions();
     m_driver = new SPIDisplayDriver(desc);
 }
 
@@ -80,10 +105,18 @@ void SPIDisplay::end_frame()
 {
     // printf("end_frame\n");
     assert(m_in_frame);
+    flush();
     m_in_frame = false;
 }
 
 // This should be called a data header or something
+//
+// Transactions are recycled in the order they were queued, which is
+// the order the SPI driver finishes them.  The driver's post_cb ISR
+// marks each one idle and gives s_finished, so a producer waiting
+// for an idle transaction sleeps instead of polling the driver.
+// A transaction is claimed (BUSY) before it's queued, so one held
+// back for merging isn't counted in s_in_flight.
 struct Transaction {
 
     enum State {
@@ -91,7 +124,7 @@ struct Transaction {
         BUSY,
     };
 
-    State m_state;
+    std::atomic<State> m_state;
     uint8_t m_frame;
     uint16_t m_y;
     spi_transaction_t m_trans;
@@ -101,18 +134,29 @@ struct Transaction {
       m_frame(0),
       m_y(0),
       m_trans{}
-    {}
+    {
+        m_trans.user = this;
+    }
+
+    bool is_busy() const
+    {
+        return m_state.load(std::memory_order_acquire) == BUSY;
+    }
 
     explicit operator TransactionID() const
     {
-        ptrdiff_t index = this - s_pool;
-        assert(index <= 0x7F && index < TRANSACTION_POOL_COUNT);
+        assert(this >= s_pool);
+        size_t index = this - s_pool;
+        assert(index <= 0x7F && index < POOL_SIZE);
         return TransactionID(index << 24 | m_frame << 16 | m_y);
     }
 
-    void enqueue_write(SPIDisplayDriver *driver, uint8_t *data, size_t byte_count)
+    void enqueue_write(SPIDisplayDriver *driver,
+                       const uint8_t *data,
+                       size_t byte_count)
     {
-        m_state = BUSY;
+        assert(is_busy());
+        s_in_flight.fetch_add(1, std::memory_order_relaxed);
         m_trans.tx_buffer = data;
         m_trans.length = byte_count * 8;
         driver->enqueue_transaction(&m_trans);
@@ -121,7 +165,7 @@ struct Transaction {
     static Transaction *find_ID(TransactionID id)
     {
         size_t index = id >> 24;
-        assert(index <= 0x7F && index < TRANSACTION_POOL_COUNT);
+        assert(index <= 0x7F && index < POOL_SIZE);
         uint8_t frame = id >> 16 & 0xFF;
         uint16_t y = id & 0xFFFF;
         Transaction *trans = s_pool + index;
@@ -131,71 +175,240 @@ struct Transaction {
         return nullptr;
     }
 
-    static Transaction *get_idle_transaction(SPIDisplayDriver *driver)
+    // Sleep until a transaction finishes.
+    static void await_finish()
+    {
+        Trace::Span span(TRACE_SPI_WAIT);
+        BaseType_t ok = xSemaphoreTake(s_finished, pdMS_TO_TICKS(1000));
+        assert(ok == pdTRUE);
+        (void)ok;
+    }
+
+    static size_t in_flight()
+    {
+        return s_in_flight.load(std::memory_order_acquire);
+    }
+
+    static bool next_is_idle()
+    {
+        return !s_pool[s_idle_rotor].is_busy();
+    }
+
+    static void await_in_flight_below(size_t limit)
+    {
+        while (in_flight() >= limit) {
+            await_finish();
+        }
+    }
+
+    static Transaction *claim_idle_transaction()
     {
         Transaction *trans = &s_pool[s_idle_rotor];
-        while (trans->m_state == BUSY) {
-            spi_transaction_t *trans_desc = driver->await_transaction();
-            assert(trans_desc == &trans->m_trans);
-            trans->m_state = IDLE;
+        while (trans->is_busy()) {
+            await_finish();
         }
-        s_idle_rotor = (s_idle_rotor + 1) % TRANSACTION_POOL_COUNT;
+        s_idle_rotor = (s_idle_rotor + 1) % POOL_SIZE;
+        trans->m_state.store(BUSY, std::memory_order_relaxed);
         return trans;
     }
 
     const char *state_name()
     {
-        switch (m_state) {
+        switch (m_state.load(std::memory_order_relaxed)) {
         case IDLE: return "IDLE";
         case BUSY: return "BUSY";
         default: return "?..?";
         }
     }
-    static void await_all_transactions(SPIDisplayDriver *driver)
-    {
-        while (s_pool[s_idle_rotor].m_state != IDLE) {
-            (void)get_idle_transaction(driver);
-        }
-    }
 
-    static const size_t TRANSACTION_POOL_COUNT = 6;
-    static Transaction s_pool[TRANSACTION_POOL_COUNT];
+    static const size_t POOL_SIZE = SPIDisplay::TRANSACTION_POOL_SIZE;
+    static Transaction s_pool[POOL_SIZE];
     static size_t s_idle_rotor;
+    static std::atomic<size_t> s_in_flight;
+    static SemaphoreHandle_t s_finished;
 };
 
-Transaction Transaction::s_pool[TRANSACTION_POOL_COUNT];
+Transaction Transaction::s_pool[POOL_SIZE];
 size_t Transaction::s_idle_rotor;
+std::atomic<size_t> Transaction::s_in_flight;
+SemaphoreHandle_t Transaction::s_finished;
+
+static void init_transactions()
+{
+    if (!Transaction::s_finished) {
+        Transaction::s_finished = xSemaphoreCreateBinary();
+        assert(Transaction::s_finished);
+    }
+}
+
+// SPI ISR.  Command bytes sent by the driver have no user
+// pointer and are ignored.
+static void IRAM_ATTR transaction_post_cb(spi_transaction_t *trans_desc)
+{
+    auto *trans = (Transaction *)trans_desc->user;
+    if (trans == nullptr) {
+        return;
+    }
+    Trace::instant(TRACE_SPI_DONE, trans->m_frame << 16 | trans->m_y);
+    trans->m_state.store(Transaction::IDLE, std::memory_order_release);
+    Transaction::s_in_flight.fetch_sub(1, std::memory_order_release);
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xSemaphoreGiveFromISR(Transaction::s_finished,
+                          &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+// Queue the held stripe.
+void SPIDisplay::flush()
+{
+    if (m_pending == nullptr) {
+        return;
+    }
+    Transaction::await_in_flight_below(m_max_in_flight);
+    Trace::instant(TRACE_SPI_QUEUE, m_pending_bytes);
+    m_pending->enqueue_write(m_driver, m_pending_data, m_pending_bytes);
+    m_transaction_count++;
+    m_pending = nullptr;
+}
+
+void SPIDisplay::set_transfer_limits(size_t max_in_flight,
+                                     size_t max_transaction_bytes)
+{
+    assert(!m_in_frame);
+    assert(1 <= max_in_flight);
+    assert(max_in_flight <= TRANSACTION_POOL_SIZE);
+    assert(max_in_flight <= SPI_QUEUE_DEPTH);
+    assert(max_transaction_bytes <= MAX_TRANSACTION_BYTES);
+    m_max_in_flight = max_in_flight;
+    m_max_transaction_bytes = max_transaction_bytes;
+}
 
 TransactionID SPIDisplay::send_stripe(
     size_t y, size_t height, const pixel_type *pixels)
+{
+    TransactionID id = queue_stripe(y, height, 0, m_frame_width, pixels, true);
+    assert(id != NO_TRANSACTION);
+    return id;
+}
+
+TransactionID SPIDisplay::send_clipped_stripe(
+    size_t y, size_t height, size_t x0, size_t x1, const pixel_type *pixels)
+{
+    TransactionID id = queue_stripe(y, height, x0, x1, pixels, true);
+    assert(id != NO_TRANSACTION);
+    return id;
+}
+
+TransactionID SPIDisplay::try_send_stripe(
+    size_t y, size_t height, const pixel_type *pixels)
+{
+    return queue_stripe(y, height, 0, m_frame_width, pixels, false);
+}
+
+TransactionID SPIDisplay::queue_stripe(
+    size_t y, size_t height,
+    size_t x0, size_t x1,
+    const pixel_type *pixels,
+    bool wait)
 {
     // printf("send_stripe(y=%zu height=%zu pixels=%p)\n", y, height, pixels);
     assert(m_in_frame);
+    assert(x0 < x1 && x1 <= m_frame_width);
+    auto *data = (const uint8_t *)pixels;
+    size_t byte_count = height * (x1 - x0) * sizeof pixels[0];
+    assert(byte_count <= MAX_TRANSACTION_BYTES);
+    x0 += m_frame_left;
+    x1 += m_frame_left;
+    bool new_window = m_frame_ready || y != m_current_y ||
+                      x0 != m_window_x0 || x1 != m_window_x1;
+
+    if (m_pending && !new_window &&
+        data == m_pending_data + m_pending_bytes &&
+        m_pending_bytes + byte_count <= m_max_transaction_bytes) {
+        m_pending_bytes += byte_count;
+        m_current_y += height;
+        Trace::instant(TRACE_SEND_STRIPE, y << 16 | byte_count);
+        return (TransactionID)*m_pending;
+    }
+
+    if (!wait) {
+        // Each stripe this call flushes, the held one and maybe the
+        // new one, needs room on the bus, or flush() would sleep.
+        size_t in_flight = Transaction::in_flight();
+        size_t flushes = m_pending ? 1 : 0;
+        if (in_flight + flushes == 0 || byte_count >= m_max_transaction_bytes) {
+            flushes++;
+        }
+        bool ready = Transaction::next_is_idle() &&
+                     in_flight + flushes <= m_max_in_flight &&
+                     (!new_window || m_driver->window_slot_free());
+        if (!ready) {
+            return NO_TRANSACTION;
+        }
+    }
+    Trace::instant(TRACE_SEND_STRIPE, y << 16 | byte_count);
+    flush();
     if (m_frame_ready) {
-        Transaction::await_all_transactions(m_driver);
-        m_driver->send_start_write_command(
-            m_frame_left, m_frame_top,
-            m_frame_right, m_frame_bottom
-        );
         m_frame++;
         m_frame_ready = false;
-        m_current_y = 0;
+        m_current_y = SIZE_MAX;
     }
-    assert(y == m_current_y);
-    Transaction *trans = Transaction::get_idle_transaction(m_driver);
+    if (new_window) {
+        // First stripe of the frame, rows were skipped, or the
+        // columns changed.  Open the address window at row y.  It
+        // queues behind the stripes already sent.
+        assert(m_current_y == SIZE_MAX || y >= m_current_y);
+        m_driver->enqueue_start_write_command(
+            x0, m_frame_top + y,
+            x1, m_frame_bottom
+        );
+        m_current_y = y;
+        m_window_x0 = x0;
+        m_window_x1 = x1;
+    }
+    Transaction *trans = Transaction::claim_idle_transaction();
     trans->m_frame = m_frame;
     trans->m_y = m_current_y;
-    size_t byte_count = height * m_frame_width * sizeof pixels[0];
-    trans->enqueue_write(m_driver, (uint8_t *)pixels, byte_count);
+    m_pending = trans;
+    m_pending_data = data;
+    m_pending_bytes = byte_count;
     m_current_y += height;
+
+    // Hold the stripe only if the bus has other work and another
+    // stripe could join it.
+    if (Transaction::in_flight() == 0 ||
+        byte_count >= m_max_transaction_bytes) {
+        flush();
+    }
     return (TransactionID)*trans;
 }
 
 void SPIDisplay::await_transaction(TransactionID id)
 {
+    if (id == NO_TRANSACTION) {
+        return;
+    }
+    // If the transaction has been recycled, it finished long ago.
+    Transaction *trans = Transaction::find_ID(id);
+    if (trans == nullptr) {
+        return;
+    }
+    if (trans == m_pending) {
+        flush();
+    }
+    while (trans->is_busy()) {
+        Transaction::await_finish();
+    }
+}
+
+bool SPIDisplay::transaction_done(TransactionID id)
+{
+    if (id == NO_TRANSACTION) {
+        return true;
+    }
     Transaction *trans = Transaction::find_ID(id);
-    assert(trans != nullptr);
-    while (trans->m_state == Transaction::BUSY) {
-        Transaction::get_idle_transaction(m_driver);
+    if (trans && trans == m_pending) {
+        flush();
     }
+    return trans == nullptr || !trans->is_busy();
 }
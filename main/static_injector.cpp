@@ -1,23 +1,75 @@
 // This file's header
 #include "static_injector.h"
 
+// C++ standard headers
+#include <algorithm>
+#include <cassert>
+#include <cstdio>
+
+// ESP-IDF headers
+#include "esp_heap_caps.h"
+
 // Component headers
+#include "crossfade.h"
+#include "dsp_memcpy.h"
 #include "pixel_types.h"
-#include "random.h"
+#include "trace.h"
 
-StaticInjector::StaticInjector()
+StaticInjector::StaticInjector(size_t bank_bytes)
 : m_active(0),
-  m_start(-1)
-{}
+  m_length(0),
+  m_start(-1),
+  m_random(RANDOM_STREAM_STATIC),
+  m_noise(m_random.rand()),
+  m_bank_storage(nullptr),
+  m_bank(nullptr)
+{
+    if (bank_bytes == 0) {
+        return;
+    }
+
+    // Internal RAM is faster to read, but the frame buffers may
+    // not have left room.
+    const char *where = "internal RAM";
+    m_bank_storage = heap_caps_aligned_alloc(DSP_ALIGNMENT,
+                                             bank_bytes,
+                                             MALLOC_CAP_INTERNAL);
+    if (!m_bank_storage) {
+        where = "PSRAM";
+        m_bank_storage = heap_caps_aligned_alloc(DSP_ALIGNMENT,
+                                                 bank_bytes,
+                                                 MALLOC_CAP_SPIRAM);
+    }
+    if (!m_bank_storage) {
+        printf("StaticInjector: no room for noise bank.  Generating.\n");
+        return;
+    }
+    m_bank = new NoiseBank(m_bank_storage,
+                           bank_bytes,
+                           IMAGE_WIDTH,
+                           DISPLAY_PIXEL_ENDIAN,
+                           m_random.rand());
+    assert(m_bank);
+    printf("StaticInjector: %zu row noise bank in %s\n",
+           m_bank->row_count(), where);
+}
+
+StaticInjector::~StaticInjector()
+{
+    delete m_bank;
+    heap_caps_free(m_bank_storage);
+}
 
 bool StaticInjector::update()
 {
     if (m_start == -1) {
         // first time
-        m_start = Random::randint(MIN_NO_STATIC, MAX_NO_STATIC);
+        m_start = m_random.randint(MIN_NO_STATIC, MAX_NO_STATIC);
     } else if (!m_active && --m_start == 0) {
         // finished inactive period
-        m_active = Random::randint(MIN_STATIC, MAX_STATIC);
+        m_active = m_random.randint(MIN_STATIC, MAX_STATIC);
+        m_length = m_active;
+        Trace::begin(TRACE_STATIC_BURST, m_length);
     }
     if (m_active) {
         if (--m_active != 0) {
@@ -25,19 +77,24 @@ bool StaticInjector::update()
             return true;
         }
         // finished active period
-        m_start = Random::randint(MIN_NO_STATIC, MAX_NO_STATIC);
+        Trace::end(TRACE_STATIC_BURST);
+        m_start = m_random.randint(MIN_NO_STATIC, MAX_NO_STATIC);
     }
     return false;
 }
 
+unsigned StaticInjector::intensity() const
+{
+    int level = std::min({m_length - m_active, m_active, RAMP_STATIC});
+    return (CROSSFADE_WEIGHT_MAX * level + RAMP_STATIC - 1) / RAMP_STATIC;
+}
+
 void StaticInjector::fill_with_static(pixel_type *pixels, size_t count)
 {
-    assert(count % 4 == 0);
-    for (size_t i = 0; i < count; i += 4) {
-        int x = Random::rand();
-        pixels[i + 0] = pixel_type::from_grey8(x >> 0 & 0xFF);
-        pixels[i + 1] = pixel_type::from_grey8(x >> 8 & 0xFF);
-        pixels[i + 2] = pixel_type::from_grey8(x >> 16 & 0xFF);
-        pixels[i + 3] = pixel_type::from_grey8(x >> 23 & 0xFF);
+    assert(count % IMAGE_WIDTH == 0);
+    if (m_bank) {
+        m_bank->fill_565(pixels, count / IMAGE_WIDTH);
+    } else {
+        m_noise.fill_565(pixels, count, DISPLAY_PIXEL_ENDIAN);
     }
 }
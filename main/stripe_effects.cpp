@@ -0,0 +1,222 @@
+// This file's header
+#include "stripe_effects.h"
+
+// C++ standard headers
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <iterator>
+
+static inline uint16_t load(const pixel_type& p)
+{
+    if (DISPLAY_PIXEL_ENDIAN == PixelEndian::BIG) {
+        return p.b[0] << 8 | p.b[1];
+    }
+    return p.b[1] << 8 | p.b[0];
+}
+
+static inline void store(pixel_type& p, uint16_t c)
+{
+    if (DISPLAY_PIXEL_ENDIAN == PixelEndian::BIG) {
+        p.b[0] = c >> 8;
+        p.b[1] = c;
+    } else {
+        p.b[0] = c;
+        p.b[1] = c >> 8;
+    }
+}
+
+// Scale all three channels by weight/32, saturating.
+static inline uint16_t scale_565(uint16_t c, unsigned weight)
+{
+    unsigned hi = std::min((c >> 11) * weight >> 5, 0x1Fu);
+    unsigned mid = std::min((c >> 5 & 0x3F) * weight >> 5, 0x3Fu);
+    unsigned lo = std::min((c & 0x1F) * weight >> 5, 0x1Fu);
+    return hi << 11 | mid << 5 | lo;
+}
+
+// Chance per refresh as a threshold for a 32 bit random number.
+static uint32_t chance_threshold(float chance)
+{
+    return std::clamp(chance, 0.0f, 1.0f) * (double)UINT32_MAX;
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Tear
+
+TearEffect::TearEffect(float chance_per_refresh, size_t max_offset)
+: m_chance(chance_threshold(chance_per_refresh)),
+  m_max_offset(std::clamp<size_t>(max_offset, 1, IMAGE_WIDTH - 1)),
+  m_band_y(0),
+  m_band_height(0),
+  m_offset(0),
+  m_refreshes_left(0),
+  m_random(RANDOM_STREAM_TEAR)
+{}
+
+void TearEffect::begin_refresh(unsigned)
+{
+    if (m_refreshes_left) {
+        m_refreshes_left--;
+    } else if (m_random.rand() < m_chance) {
+        m_refreshes_left = m_random.randint(1, 5);
+        m_band_height = m_random.randint(4, 48);
+        m_band_y = m_random.randint(0, IMAGE_HEIGHT - m_band_height);
+    }
+    if (m_refreshes_left) {
+        // The tear wobbles while it lasts.
+        m_offset = m_random.randint(size_t(1), m_max_offset + 1);
+    }
+}
+
+bool TearEffect::applies(size_t y, size_t height) const
+{
+    return m_refreshes_left &&
+           y < m_band_y + m_band_height &&
+           m_band_y < y + height;
+}
+
+void TearEffect::apply(pixel_type *stripe, size_t y, size_t height)
+{
+    size_t first = std::max(y, m_band_y);
+    size_t last = std::min(y + height, m_band_y + m_band_height);
+    for (size_t row = first; row < last; row++) {
+        pixel_type *p = stripe + (row - y) * IMAGE_WIDTH;
+        std::rotate(p, p + m_offset, p + IMAGE_WIDTH);
+    }
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Scan Bar
+
+ScanBarEffect::ScanBarEffect(unsigned period_refreshes,
+                             size_t bar_height,
+                             unsigned gain)
+: m_period(std::max(period_refreshes, 1u)),
+  m_bar_height(std::max(bar_height, size_t(2))),
+  m_gain(gain),
+  m_bar_y(-m_bar_height)
+{}
+
+// The bar starts just above the screen and ends just below it.
+void ScanBarEffect::begin_refresh(unsigned refresh)
+{
+    int travel = IMAGE_HEIGHT + m_bar_height;
+    m_bar_y = (int)(refresh % m_period * travel / m_period) - m_bar_height;
+}
+
+bool ScanBarEffect::applies(size_t y, size_t height) const
+{
+    return (int)y < m_bar_y + m_bar_height && m_bar_y < (int)(y + height);
+}
+
+// Triangular profile: full gain in the middle of the bar, none at
+// its edges.
+void ScanBarEffect::apply(pixel_type *stripe, size_t y, size_t height)
+{
+    int half = m_bar_height / 2;
+    int first = std::max((int)y, m_bar_y);
+    int last = std::min((int)(y + height), m_bar_y + m_bar_height);
+    for (int row = first; row < last; row++) {
+        int from_middle = std::abs(row - m_bar_y - half);
+        int level = std::max(half - from_middle, 0);
+        unsigned weight = 32 + ((int)m_gain - 32) * level / half;
+        if (weight == 32) {
+            continue;
+        }
+        pixel_type *p = stripe + (row - y) * IMAGE_WIDTH;
+        for (size_t x = 0; x < IMAGE_WIDTH; x++) {
+            store(p[x], scale_565(load(p[x]), weight));
+        }
+    }
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Channel Shift
+
+ChannelShiftEffect::ChannelShiftEffect(float chance_per_refresh,
+                                       size_t max_shift)
+: m_chance(chance_threshold(chance_per_refresh)),
+  m_max_shift(std::clamp<size_t>(max_shift, 1, IMAGE_WIDTH - 1)),
+  m_shift(0),
+  m_refreshes_left(0),
+  m_random(RANDOM_STREAM_CHANNEL_SHIFT)
+{}
+
+void ChannelShiftEffect::begin_refresh(unsigned)
+{
+    if (m_refreshes_left) {
+        m_refreshes_left--;
+    } else if (m_random.rand() < m_chance) {
+        m_refreshes_left = m_random.randint(2, 8);
+        m_shift = m_random.randint(size_t(1), m_max_shift + 1);
+    }
+}
+
+bool ChannelShiftEffect::applies(size_t, size_t) const
+{
+    return m_refreshes_left != 0;
+}
+
+// In place: the high channel is read ahead of where it's written,
+// and the low channel behind.
+void ChannelShiftEffect::apply(pixel_type *stripe, size_t, size_t height)
+{
+    const uint16_t HI = 0xF800, LO = 0x001F;
+    const size_t s = m_shift;
+    for (size_t row = 0; row < height; row++) {
+        pixel_type *p = stripe + row * IMAGE_WIDTH;
+        for (size_t x = 0; x < IMAGE_WIDTH; x++) {
+            uint16_t from = x + s < IMAGE_WIDTH ? load(p[x + s]) : 0;
+            store(p[x], (load(p[x]) & ~HI) | (from & HI));
+        }
+        for (size_t x = IMAGE_WIDTH; x-- > 0; ) {
+            uint16_t from = x >= s ? load(p[x - s]) : 0;
+            store(p[x], (load(p[x]) & ~LO) | (from & LO));
+        }
+    }
+}
+
+
+// //  //   //    //     //      //       //      //     //    //   //  // //
+// Vignette
+
+VignetteEffect::VignetteEffect(float inner_radius, unsigned edge_weight)
+{
+    static_assert(IMAGE_WIDTH == IMAGE_HEIGHT);
+    assert(edge_weight <= 32);
+
+    const float half = IMAGE_WIDTH / 2.0f;
+    for (size_t x = 0; x < IMAGE_WIDTH; x++) {
+        float d = (x + 0.5f - half) / half;
+        m_d2[x] = d * d * EDGE_D2;
+    }
+
+    size_t inner_d2 = inner_radius * inner_radius * EDGE_D2;
+    for (size_t d2 = 0; d2 < std::size(m_weight); d2++) {
+        if (d2 <= inner_d2 || inner_d2 >= EDGE_D2) {
+            m_weight[d2] = 32;
+        } else {
+            size_t fall = std::min(d2, EDGE_D2) - inner_d2;
+            m_weight[d2] = 32 - (32 - edge_weight) * fall /
+                                (EDGE_D2 - inner_d2);
+        }
+    }
+}
+
+void VignetteEffect::apply(pixel_type *stripe, size_t y, size_t height)
+{
+    for (size_t row = 0; row < height; row++) {
+        pixel_type *p = stripe + row * IMAGE_WIDTH;
+        uint16_t dy2 = m_d2[y + row];
+        for (size_t x = 0; x < IMAGE_WIDTH; x++) {
+            unsigned weight = m_weight[m_d2[x] + dy2];
+            if (weight != 32) {
+                store(p[x], scale_565(load(p[x]), weight));
+            }
+        }
+    }
+}
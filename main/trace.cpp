@@ -0,0 +1,153 @@
+// This file's header
+#include "trace.h"
+
+// C++ standard headers
+#include <cinttypes>
+
+// ESP-IDF headers
+#include "esp_attr.h"
+
+// The dump format, which tools/trace_to_json.py reads:
+//
+//     --- trace begin ---
+//     trace: <ring size> event ring, <events recorded> recorded
+//     trace id <n> <name> <instant|span|async>
+//     ...
+//     <base64, 64 characters a line>
+//     --- trace end ---
+//
+// The base64 decodes to 12 byte little endian records:
+//
+//     uint32_t usec;   // esp_timer_get_time(), low 32 bits
+//     uint16_t id;
+//     uint8_t kind;    // 0 begin, 1 end, 2 instant
+//     uint8_t core;
+//     uint32_t arg;
+//
+// Events are in recording order.  Torn events are left out.
+
+#if CONFIG_TRACE_ENABLE
+
+// In TraceID order.
+static const struct {
+    const char *name;
+    const char *style;
+} s_ids[] = {
+    { "refresh",      "instant" },
+    { "send_stripe",  "instant" },
+    { "spi_queue",    "instant" },
+    { "spi_done",     "instant" },
+    { "spi_wait",     "span" },
+    { "load_frame",   "span" },
+    { "static_burst", "async" },
+};
+static_assert(sizeof s_ids / sizeof s_ids[0] == TRACE_ID_COUNT);
+
+DRAM_ATTR Trace::Event Trace::s_ring[EVENT_COUNT];
+std::atomic<uint32_t> Trace::s_next;
+std::atomic<bool> Trace::s_paused;
+
+static const size_t RECORD_BYTES = 12;
+
+// Encodes 48 bytes, four records, per 64 character line.
+class Base64Writer {
+
+public:
+    Base64Writer(FILE *out) : m_out(out), m_used(0) {}
+
+    void write(const uint8_t *bytes, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            m_buffer[m_used++] = bytes[i];
+            if (m_used == LINE_BYTES) {
+                flush();
+            }
+        }
+    }
+
+    void flush()
+    {
+        static const char digits[] =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        if (m_used == 0) {
+            return;
+        }
+        char line[LINE_BYTES / 3 * 4 + 2];
+        char *p = line;
+        for (size_t i = 0; i < m_used; i += 3) {
+            size_t n = m_used - i < 3 ? m_used - i : 3;
+            uint32_t v = m_buffer[i] << 16;
+            if (n > 1) {
+                v |= m_buffer[i + 1] << 8;
+            }
+            if (n > 2) {
+                v |= m_buffer[i + 2];
+            }
+            *p++ = digits[v >> 18 & 0x3F];
+            *p++ = digits[v >> 12 & 0x3F];
+            *p++ = n > 1 ? digits[v >> 6 & 0x3F] : '=';
+            *p++ = n > 2 ? digits[v & 0x3F] : '=';
+        }
+        *p++ = '\n';
+        *p = '\0';
+        fputs(line, m_out);
+        m_used = 0;
+    }
+
+private:
+    static const size_t LINE_BYTES = 48;
+
+    FILE *m_out;
+    uint8_t m_buffer[LINE_BYTES];
+    size_t m_used;
+};
+
+static void put_le(uint8_t *p, uint32_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; i++) {
+        p[i] = value >> 8 * i;
+    }
+}
+
+void Trace::dump(FILE *out)
+{
+    s_paused.store(true, std::memory_order_relaxed);
+    uint32_t next = s_next.load(std::memory_order_acquire);
+    uint32_t first = next > EVENT_COUNT ? next - EVENT_COUNT : 0;
+
+    fprintf(out, "--- trace begin ---\n");
+    fprintf(out, "trace: %zu event ring, %" PRIu32 " recorded\n",
+            EVENT_COUNT, next);
+    for (size_t id = 0; id < TRACE_ID_COUNT; id++) {
+        fprintf(out, "trace id %zu %s %s\n",
+                id, s_ids[id].name, s_ids[id].style);
+    }
+    Base64Writer writer(out);
+    for (uint32_t seq = first; seq != next; seq++) {
+        const Event& e = s_ring[seq & (EVENT_COUNT - 1)];
+        if (__atomic_load_n(&e.seq, __ATOMIC_ACQUIRE) != seq + 1) {
+            continue;
+        }
+        uint8_t record[RECORD_BYTES];
+        put_le(record + 0, e.usec, 4);
+        put_le(record + 4, e.id, 2);
+        record[6] = e.kind;
+        record[7] = e.core;
+        put_le(record + 8, e.arg, 4);
+        writer.write(record, sizeof record);
+    }
+    writer.flush();
+    fprintf(out, "--- trace end ---\n");
+    fflush(out);
+
+    s_paused.store(false, std::memory_order_relaxed);
+}
+
+#else
+
+void Trace::dump(FILE *out)
+{
+    fprintf(out, "trace: disabled in this build\n");
+}
+
+#endif
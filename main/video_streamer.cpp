@@ -5,39 +5,60 @@
 #include <cstring>
 
 // ESP-IDF headers
+#include "esp_attr.h"
 #include "freertos/FreeRTOS.h"
 
 // Component headers
 #include "animation.h"
 #include "board_defs.h"
-#include "random.h"
+#include "crossfade.h"
+#include "dsp_memcpy.h"
 #include "spi_display.h"
 #include "static_injector.h"
+#include "stripe_effects.h"
 #include "pixel_types.h"
 
 
-static const size_t STATIC_STRIPE_COUNT = 6;
 static const size_t STRIPE_HEIGHT = SPIDisplay::STRIPE_HEIGHT;
 static const size_t STRIPE_SIZE =
     STRIPE_HEIGHT * IMAGE_WIDTH * sizeof (pixel_type);
+static const size_t STRIPE_COUNT = IMAGE_HEIGHT / STRIPE_HEIGHT;
 
-size_t VideoStreamer::s_static_rotor;
-
-static pixel_type DMA_ATTR
-    static_stripes[STATIC_STRIPE_COUNT]
-                  [STRIPE_HEIGHT]
-                  [IMAGE_WIDTH];
+size_t VideoStreamer::s_stripe_rotor;
+TransactionID VideoStreamer::s_stripe_buffer_trans[STRIPE_BUFFER_COUNT];
+pixel_type DMA_ATTR DSP_ALIGNED_ATTR
+    VideoStreamer::s_stripe_buffers[STRIPE_BUFFER_COUNT]
+                                   [STRIPE_HEIGHT]
+                                   [IMAGE_WIDTH];
 
 
 VideoStreamer::VideoStreamer(
-    const Animation& src,
+    Animation& src,
     SPIDisplay& dest,
-    bool inject_static)
+    StaticEffect static_effect,
+    size_t static_bank_bytes,
+    bool crossfade,
+    bool round_clip,
+    StripeEffectChain *effects)
 : m_source(src),
   m_display(dest),
-  m_inject_static(inject_static)
+  m_static_effect(static_effect),
+  m_crossfade(crossfade),
+  m_effects(effects),
+  m_spans(dest.width(),
+          dest.height(),
+          round_clip && dest.is_round(),
+          IMAGE_WIDTH,
+          IMAGE_HEIGHT),
+  m_visible(true),
+  m_dirty_stripes(all_stripes(STRIPE_COUNT)),
+  m_frame_serial(src.frame_serial())
 {
-    m_static_source = new StaticInjector;
+    for (auto& id : s_stripe_buffer_trans) {
+        id = NO_TRANSACTION;
+    }
+    src.set_display(&dest);
+    m_static_source = new StaticInjector(static_bank_bytes);
     assert(m_static_source);
     fill_with_black();
 }
@@ -49,38 +70,201 @@ VideoStreamer::~VideoStreamer()
 
 void VideoStreamer::update()
 {
+    if (!m_visible) {
+        m_frame_serial = m_source.frame_serial();
+        m_dirty_stripes = all_stripes(STRIPE_COUNT);
+        return;
+    }
+
+    unsigned serial = m_source.frame_serial();
+    if (serial == m_frame_serial + 1) {
+        m_dirty_stripes |= m_source.changed_stripes();
+    } else if (serial != m_frame_serial) {
+        m_dirty_stripes = all_stripes(STRIPE_COUNT);
+    }
+    m_frame_serial = serial;
+
+    if (m_effects) {
+        m_effects->begin_refresh();
+        m_dirty_stripes |= m_effects->forced_stripes();
+    }
+
+    // Stripes the next frame changes are blended toward it.
+    // A dissolve between clips changes every stripe.
+    bool dissolving = m_source.dissolving();
+    StripeMask fading = 0;
+    const image_type *next = nullptr;
+    unsigned weight = 0;
+    if (dissolving) {
+        weight = m_source.dissolve_weight();
+    } else if (m_crossfade) {
+        next = m_source.next_frame(&fading);
+        weight = m_source.fade_weight();
+        if (!next || weight == 0) {
+            fading = 0;
+        }
+    }
+
     m_display.begin_frame_centered(IMAGE_WIDTH, IMAGE_HEIGHT);
 
     static_assert(IMAGE_HEIGHT % STRIPE_HEIGHT == 0);
     for (size_t y = 0; y < IMAGE_HEIGHT; y += STRIPE_HEIGHT) {
-        if (m_inject_static && m_static_source->update()) {
+        StripeMask bit = stripe_bit(y / STRIPE_HEIGHT);
+        bool is_static = m_static_effect != NO_STATIC &&
+                         m_static_source->update();
+        if (is_static && m_static_effect == STATIC_OVERLAY) {
+            send_noisy_stripe(y,
+                              STRIPE_HEIGHT,
+                              m_static_source->intensity());
+            m_dirty_stripes |= bit;
+        } else if (is_static) {
             send_static_stripe(y, STRIPE_HEIGHT);
-        } else {
+            m_dirty_stripes |= bit;
+        } else if (dissolving) {
+            send_dissolved_stripe(y, STRIPE_HEIGHT, weight);
+            m_dirty_stripes |= bit;
+        } else if (fading & bit) {
+            send_blended_stripe(y, STRIPE_HEIGHT, next, weight);
+            m_dirty_stripes |= bit;
+        } else if (m_dirty_stripes & bit) {
             send_image_stripe(y, STRIPE_HEIGHT);
+            m_dirty_stripes &= ~bit;
         }
     }
     m_display.end_frame();
 }
 
+// Wait until the oldest stripe buffer is off the bus, then claim it.
+size_t VideoStreamer::claim_stripe_buffer()
+{
+    size_t index = s_stripe_rotor;
+    s_stripe_rotor = (s_stripe_rotor + 1) % STRIPE_BUFFER_COUNT;
+    m_display.await_transaction(s_stripe_buffer_trans[index]);
+    s_stripe_buffer_trans[index] = NO_TRANSACTION;
+    return index;
+}
+
+// Effects are applied in the bounce buffer that's sent.
+void VideoStreamer::apply_effects(pixel_type *stripe, size_t y, size_t height)
+{
+    if (m_effects) {
+        m_effects->apply(stripe, y, height);
+    }
+}
+
+// Send a stripe from a bounce buffer, copying it there from source
+// first if it isn't there.  If the panel doesn't show all of it,
+// the part it shows is packed into the buffer and sent alone.
+TransactionID VideoStreamer::send_bounced_stripe(size_t y,
+                                                 size_t height,
+                                                 pixel_type *stripe,
+                                                 const pixel_type *source)
+{
+    if (m_spans.is_whole(m_spans.stripe(y, height))) {
+        if (source != stripe) {
+            dsp_memcpy(stripe, source, height * IMAGE_WIDTH * sizeof *stripe);
+        }
+        return m_display.send_stripe(y, height, stripe);
+    }
+    auto span = m_spans.gather(stripe, source, y, height, sizeof *stripe);
+    return m_display.send_clipped_stripe(y, height, span.x0, span.x1, stripe);
+}
+
 void VideoStreamer::send_image_stripe(size_t y, size_t height)
 {
-    const image_type *frame = m_source.current_frame();
-    const pixel_type *stripe = (*frame)[y];
-    m_last_trans = m_display.send_stripe(y, height, stripe);
+    bool effects = m_effects && m_effects->applies(y, height);
+    bool whole = m_spans.is_whole(m_spans.stripe(y, height));
+    if (!m_source.streams_stripes() && !effects && whole) {
+        const pixel_type *stripe = m_source.stripe(y, nullptr);
+        m_last_trans = m_display.send_stripe(y, height, stripe);
+        m_source.set_frame_transaction(m_last_trans);
+        return;
+    }
+
+    // Decode the stripe from flash into a bounce buffer.  Effects
+    // mustn't change the frame buffer, so they get a copy of it.
+    size_t index = claim_stripe_buffer();
+    pixel_type *stripe = *s_stripe_buffers[index];
+    const pixel_type *source = m_source.stripe(y, stripe);
+    if (effects) {
+        if (source != stripe) {
+            dsp_memcpy(stripe, source, height * IMAGE_WIDTH * sizeof *stripe);
+            source = stripe;
+        }
+        apply_effects(stripe, y, height);
+    }
+    m_last_trans = send_bounced_stripe(y, height, stripe, source);
+    s_stripe_buffer_trans[index] = m_last_trans;
+}
+
+// The outgoing stripe is decoded into the buffer that's sent, if
+// it needs decoding, and the incoming stripe into a second one.
+void VideoStreamer::send_dissolved_stripe(size_t y,
+                                          size_t height,
+                                          unsigned weight)
+{
+    size_t index = claim_stripe_buffer();
+    pixel_type *stripe = *s_stripe_buffers[index];
+    pixel_type *scratch = *s_stripe_buffers[claim_stripe_buffer()];
+    crossfade_565(stripe,
+                  m_source.stripe(y, stripe),
+                  m_source.incoming_stripe(y, scratch),
+                  height * IMAGE_WIDTH,
+                  weight,
+                  DISPLAY_PIXEL_ENDIAN);
+    apply_effects(stripe, y, height);
+    m_last_trans = send_bounced_stripe(y, height, stripe, stripe);
+    s_stripe_buffer_trans[index] = m_last_trans;
+}
+
+void VideoStreamer::send_blended_stripe(size_t y,
+                                        size_t height,
+                                        const image_type *next,
+                                        unsigned weight)
+{
+    size_t index = claim_stripe_buffer();
+    pixel_type *stripe = *s_stripe_buffers[index];
+    crossfade_565(stripe,
+                  m_source.stripe(y, nullptr),
+                  (*next)[y],
+                  height * IMAGE_WIDTH,
+                  weight,
+                  DISPLAY_PIXEL_ENDIAN);
+    apply_effects(stripe, y, height);
+    m_last_trans = send_bounced_stripe(y, height, stripe, stripe);
+    s_stripe_buffer_trans[index] = m_last_trans;
 }
 
 void VideoStreamer::send_static_stripe(size_t y, size_t height)
 {
-    pixel_type *stripe = *static_stripes[s_static_rotor];
-    s_static_rotor = (s_static_rotor + 1) % STATIC_STRIPE_COUNT;
-    for (size_t i = 0; i < STRIPE_HEIGHT * IMAGE_WIDTH; i += 4) {
-        int x = Random::rand();
-        stripe[i + 0] = pixel_type::from_grey8(x >> 0 & 0xFF);
-        stripe[i + 1] = pixel_type::from_grey8(x >> 8 & 0xFF);
-        stripe[i + 2] = pixel_type::from_grey8(x >> 16 & 0xFF);
-        stripe[i + 3] = pixel_type::from_grey8(x >> 23 & 0xFF);
-    }
-    m_last_trans = m_display.send_stripe(y, STRIPE_HEIGHT, stripe);
+    size_t index = claim_stripe_buffer();
+    pixel_type *stripe = *s_stripe_buffers[index];
+    m_static_source->fill_with_static(stripe, STRIPE_HEIGHT * IMAGE_WIDTH);
+    apply_effects(stripe, y, STRIPE_HEIGHT);
+    m_last_trans = send_bounced_stripe(y, STRIPE_HEIGHT, stripe, stripe);
+    s_stripe_buffer_trans[index] = m_last_trans;
+}
+
+// Noise goes in a second buffer and is added to the image stripe.
+// The stripe under the noise doesn't fade or dissolve; it catches up
+// when the burst ends.
+void VideoStreamer::send_noisy_stripe(size_t y,
+                                      size_t height,
+                                      unsigned intensity)
+{
+    size_t index = claim_stripe_buffer();
+    pixel_type *stripe = *s_stripe_buffers[index];
+    pixel_type *noise = *s_stripe_buffers[claim_stripe_buffer()];
+    m_static_source->fill_with_static(noise, height * IMAGE_WIDTH);
+    add_565(stripe,
+            m_source.stripe(y, stripe),
+            noise,
+            height * IMAGE_WIDTH,
+            intensity,
+            DISPLAY_PIXEL_ENDIAN);
+    apply_effects(stripe, y, height);
+    m_last_trans = send_bounced_stripe(y, height, stripe, stripe);
+    s_stripe_buffer_trans[index] = m_last_trans;
 }
 
 void VideoStreamer::fill_with_black()
@@ -88,11 +272,11 @@ void VideoStreamer::fill_with_black()
     size_t w = m_display.width();
     size_t h = m_display.height();
     assert(h % STRIPE_HEIGHT == 0);
-    pixel_type *black_stripe = static_stripes[0][0];
+    size_t index = claim_stripe_buffer();
+    pixel_type *black_stripe = s_stripe_buffers[index][0];
     std::memset(black_stripe, 0, STRIPE_SIZE);
-    // Rely on this being zeroed at app startup.  Sloppy.
     m_display.begin_frame(w, h, 0, 0);
-    for (int y = 0; y < h; y += STRIPE_HEIGHT) {
+    for (size_t y = 0; y < h; y += STRIPE_HEIGHT) {
         m_last_trans =
             m_display.send_stripe(y, STRIPE_HEIGHT, black_stripe);
     }
@@ -0,0 +1,120 @@
+// Host test of the crossfade and add reference kernels.
+//
+//   g++ -std=c++20 -I../main/include t_crossfade.cpp ../main/crossfade.cpp
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../main/include/crossfade.h"
+
+static const size_t N = 4096;
+
+alignas(16) static uint16_t a[N], b[N], d[N];
+
+// Unpack a native-endian 565 pixel.
+static void channels(uint16_t c, int ch[3])
+{
+    ch[0] = c >> 11;
+    ch[1] = c >> 5 & 0x3F;
+    ch[2] = c & 0x1F;
+}
+
+static uint16_t swap(uint16_t c)
+{
+    return c << 8 | c >> 8;
+}
+
+int main()
+{
+    srand(1);
+    for (size_t i = 0; i < N; i++) {
+        a[i] = rand();
+        b[i] = rand();
+    }
+    // and the extremes
+    a[0] = 0x0000; b[0] = 0xFFFF;
+    a[1] = 0xFFFF; b[1] = 0x0000;
+
+    // Host is little endian, so LITTLE is native.
+    for (unsigned w = 0; w <= CROSSFADE_WEIGHT_MAX; w++) {
+        crossfade_565_reference(d, a, b, N, w, PixelEndian::LITTLE);
+        for (size_t i = 0; i < N; i++) {
+            int ca[3], cb[3], cd[3];
+            channels(a[i], ca);
+            channels(b[i], cb);
+            channels(d[i], cd);
+            for (int j = 0; j < 3; j++) {
+                float f = ca[j] + (cb[j] - ca[j]) * (float)w / 32.0f;
+                assert(cd[j] == (int)std::floor(f));
+            }
+        }
+        if (w == 0) {
+            for (size_t i = 0; i < N; i++) {
+                assert(d[i] == a[i]);
+            }
+        }
+        if (w == CROSSFADE_WEIGHT_MAX) {
+            for (size_t i = 0; i < N; i++) {
+                assert(d[i] == b[i]);
+            }
+        }
+    }
+
+    // Big endian is the same blend on swapped bytes.
+    alignas(16) static uint16_t sa[N], sb[N], sd[N];
+    for (size_t i = 0; i < N; i++) {
+        sa[i] = swap(a[i]);
+        sb[i] = swap(b[i]);
+    }
+    for (unsigned w = 0; w <= CROSSFADE_WEIGHT_MAX; w += 7) {
+        crossfade_565_reference(d, a, b, N, w, PixelEndian::LITTLE);
+        crossfade_565_reference(sd, sa, sb, N, w, PixelEndian::BIG);
+        for (size_t i = 0; i < N; i++) {
+            assert(sd[i] == swap(d[i]));
+        }
+    }
+
+    // Off target, crossfade_565 falls back to the reference.
+    crossfade_565(sd, sa, sb, N, 13, PixelEndian::BIG);
+    crossfade_565_reference(d, sa, sb, N, 13, PixelEndian::BIG);
+    for (size_t i = 0; i < N; i++) {
+        assert(sd[i] == d[i]);
+    }
+
+    // add_565: a plus scaled b, saturated per channel.
+    for (unsigned w = 0; w <= CROSSFADE_WEIGHT_MAX; w++) {
+        add_565_reference(d, a, b, N, w, PixelEndian::LITTLE);
+        for (size_t i = 0; i < N; i++) {
+            int ca[3], cb[3], cd[3];
+            const int max[3] = { 31, 63, 31 };
+            channels(a[i], ca);
+            channels(b[i], cb);
+            channels(d[i], cd);
+            for (int j = 0; j < 3; j++) {
+                float f = ca[j] + cb[j] * (float)w / 32.0f;
+                int expected = std::min((int)std::floor(f), max[j]);
+                assert(cd[j] == expected);
+            }
+        }
+        if (w == 0) {
+            assert(!memcmp(d, a, sizeof d));
+        }
+    }
+    for (unsigned w = 0; w <= CROSSFADE_WEIGHT_MAX; w += 7) {
+        add_565_reference(d, a, b, N, w, PixelEndian::LITTLE);
+        add_565_reference(sd, sa, sb, N, w, PixelEndian::BIG);
+        for (size_t i = 0; i < N; i++) {
+            assert(sd[i] == swap(d[i]));
+        }
+    }
+    add_565(sd, sa, sb, N, 13, PixelEndian::BIG);
+    add_565_reference(d, sa, sb, N, 13, PixelEndian::BIG);
+    assert(!memcmp(sd, d, sizeof d));
+
+    printf("OK\n");
+    return 0;
+}
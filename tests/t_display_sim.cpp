@@ -0,0 +1,177 @@
+// Host test of SPIDisplay and the real display driver against the
+// simulated panel.  Give a directory to dump the frames as PPM.
+//
+//   g++ -std=c++20 -O2 -I../host/include -I../main/include
+//       t_display_sim.cpp ../host/display_sim.cpp ../host/host_freertos.cpp
+//       ../host/host_esp.cpp ../main/spi_display.cpp ../main/driver_display.cpp
+//       ../main/display_controllers.cpp ../main/panel_spans.cpp
+//       ../main/trace.cpp
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "display_sim.h"
+#include "panel_spans.h"
+#include "pixel_types.h"
+#include "spi_display.h"
+
+static const size_t H = SPIDisplay::STRIPE_HEIGHT;
+static const size_t X_OFFSET = (DISPLAY_WIDTH - IMAGE_WIDTH) / 2;
+static const size_t Y_OFFSET = (DISPLAY_HEIGHT - IMAGE_HEIGHT) / 2;
+static const size_t FRAME_BYTES = sizeof (image_type);
+
+static int s_errors;
+
+#define CHECK(cond)                                                     \
+    do {                                                                \
+        if (!(cond)) {                                                  \
+            printf("%s:%d: %s\n", __FILE__, __LINE__, #cond);           \
+            s_errors++;                                                 \
+        }                                                               \
+    } while (0)
+
+static uint16_t sent(const pixel_type& p)
+{
+    return p.b[0] << 8 | p.b[1];
+}
+
+static void make_image(image_type& image, unsigned seed)
+{
+    for (size_t y = 0; y < IMAGE_HEIGHT; y++) {
+        for (size_t x = 0; x < IMAGE_WIDTH; x++) {
+            image[y][x] = pixel_type(x + seed, y * seed, (x ^ y) + seed);
+        }
+    }
+}
+
+// Count the image pixels the panel doesn't match, in rows the mask
+// marks.
+static size_t mismatches(const image_type& image,
+                         const std::vector<bool>& rows)
+{
+    size_t count = 0;
+    for (size_t y = 0; y < IMAGE_HEIGHT; y++) {
+        if (!rows[y]) {
+            continue;
+        }
+        for (size_t x = 0; x < IMAGE_WIDTH; x++) {
+            uint16_t got = display_sim_pixel(x + X_OFFSET, y + Y_OFFSET);
+            count += got != sent(image[y][x]);
+        }
+    }
+    return count;
+}
+
+static void report(const char *name, const DisplaySimStats& s)
+{
+    printf("%-10s %3zu transactions  %2zu windows  %6zu pixel bytes"
+           "  %4zu command bytes  %7.1f usec bus\n",
+           name, s.transactions, s.windows, s.pixel_bytes,
+           s.command_bytes, s.bus_usec);
+}
+
+int main(int argc, char **argv)
+{
+    std::string dump;
+    if (argc > 1) {
+        dump = std::string(argv[1]) + "/frame%02u.ppm";
+        display_sim_dump_frames(dump.c_str());
+    }
+
+    static image_type a, b, c;
+    make_image(a, 1);
+    make_image(b, 7);
+    make_image(c, 13);
+
+    SPIDisplay display;
+    DisplaySimStats init = display_sim_end_frame();
+    report("init", init);
+    CHECK(init.offscreen_pixels == 0);
+
+    // A whole frame.  The stripes are adjacent in memory, so they
+    // merge.
+    display.begin_frame_centered(IMAGE_WIDTH, IMAGE_HEIGHT);
+    TransactionID id = NO_TRANSACTION;
+    for (size_t y = 0; y < IMAGE_HEIGHT; y += H) {
+        id = display.send_stripe(y, H, a[y]);
+    }
+    display.end_frame();
+    display.await_transaction(id);
+    DisplaySimStats whole = display_sim_end_frame();
+    report("whole", whole);
+    CHECK(whole.pixel_bytes == FRAME_BYTES);
+    CHECK(whole.windows == 1);
+    CHECK(whole.window_wraps == 0 && whole.offscreen_pixels == 0);
+    CHECK(mismatches(a, std::vector<bool>(IMAGE_HEIGHT, true)) == 0);
+
+    // Skip some stripes, with try_send_stripe.  Skipped rows keep
+    // the last frame.
+    std::vector<bool> sent_rows(IMAGE_HEIGHT), kept_rows(IMAGE_HEIGHT);
+    display.begin_frame_centered(IMAGE_WIDTH, IMAGE_HEIGHT);
+    size_t windows = 0;
+    bool skipping = true;
+    for (size_t y = 0; y < IMAGE_HEIGHT; y += H) {
+        bool skip = y / H % 5 == 2 || y / H % 5 == 3;
+        for (size_t row = y; row < y + H; row++) {
+            sent_rows[row] = !skip;
+            kept_rows[row] = skip;
+        }
+        if (skip) {
+            skipping = true;
+            continue;
+        }
+        windows += skipping;
+        skipping = false;
+        while ((id = display.try_send_stripe(y, H, b[y])) == NO_TRANSACTION) {
+            continue;
+        }
+    }
+    display.end_frame();
+    display.await_transaction(id);
+    DisplaySimStats skipped = display_sim_end_frame();
+    report("skipping", skipped);
+    CHECK(skipped.windows == windows);
+    CHECK(skipped.window_wraps == 0 && skipped.offscreen_pixels == 0);
+    CHECK(mismatches(b, sent_rows) == 0);
+    CHECK(mismatches(a, kept_rows) == 0);
+
+    // Clipped to the round panel.  Nothing outside the spans is
+    // touched.
+    PanelSpans spans(DISPLAY_WIDTH, DISPLAY_HEIGHT, true,
+                     IMAGE_WIDTH, IMAGE_HEIGHT);
+    const uint16_t BLANK = 0xA5A5;
+    display_sim_fill(BLANK);
+    static pixel_type packed[IMAGE_HEIGHT / H][H * IMAGE_WIDTH];
+    size_t clipped_bytes = 0;
+    display.begin_frame_centered(IMAGE_WIDTH, IMAGE_HEIGHT);
+    for (size_t y = 0; y < IMAGE_HEIGHT; y += H) {
+        pixel_type *stripe = packed[y / H];
+        auto s = spans.gather(stripe, c[y], y, H, sizeof *stripe);
+        id = display.send_clipped_stripe(y, H, s.x0, s.x1, stripe);
+        clipped_bytes += s.width() * H * sizeof *stripe;
+    }
+    display.end_frame();
+    display.await_transaction(id);
+    DisplaySimStats clipped = display_sim_end_frame();
+    report("clipped", clipped);
+    CHECK(clipped.pixel_bytes == clipped_bytes);
+    CHECK(clipped.window_wraps == 0 && clipped.offscreen_pixels == 0);
+    size_t wrong = 0;
+    for (size_t y = 0; y < IMAGE_HEIGHT; y++) {
+        auto s = spans.stripe(y / H * H, H);
+        for (size_t x = 0; x < IMAGE_WIDTH; x++) {
+            bool inside = s.x0 <= x && x < s.x1;
+            uint16_t want = inside ? sent(c[y][x]) : BLANK;
+            wrong += display_sim_pixel(x + X_OFFSET, y + Y_OFFSET) != want;
+        }
+    }
+    CHECK(wrong == 0);
+    printf("clipping saves %zu of %zu bytes, %.1f usec of bus per frame\n",
+           FRAME_BYTES - clipped.pixel_bytes, FRAME_BYTES,
+           whole.bus_usec - clipped.bus_usec);
+
+    printf(s_errors ? "FAIL\n" : "OK\n");
+    return s_errors != 0;
+}
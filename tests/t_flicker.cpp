@@ -0,0 +1,93 @@
+// Host check of the flicker curve: the phasors update() steps match
+// the sum of sines they replaced, and dark_refreshes() agrees with
+// what the backlight is actually given.
+//
+//   g++ -std=c++20 -O2 -I../host/include -I../main/include t_flicker.cpp
+//       ../main/flicker_effect.cpp ../main/driver_backlight.cpp
+//       ../host/host_esp.cpp ../host/host_freertos.cpp
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numbers>
+#include <vector>
+
+#include "../main/include/flicker_effect.h"
+
+// As configured in main.cpp: 70 seconds at 60 Hz.
+static const unsigned FRAMES = 70 * 60;
+static const unsigned LOOPS = 3;
+static const float TOLERANCE = 1e-3f;
+
+// The curve as it was computed before, sines and all.
+static float reference_function(unsigned frame)
+{
+    const float TAU = 2.0 * std::numbers::pi;
+    float x = (float)frame / (float)FRAMES;
+    float acc = 0.0f;
+    for (int h = 0; h < 10; h++) {
+        acc += std::sin(std::pow(h + 1.0f, 1.5f) * TAU * x);
+    }
+    acc += 1.0f;
+    return std::max(-acc, 0.0f);
+}
+
+int main()
+{
+    std::vector<float> reference(FRAMES);
+    float max = 0.0f;
+    for (unsigned f = 0; f < FRAMES; f++) {
+        reference[f] = reference_function(f);
+        max = std::max(max, reference[f]);
+    }
+    for (auto& r : reference) {
+        r /= max;
+    }
+
+    Backlight backlight;
+    auto t0 = std::chrono::steady_clock::now();
+    SpookyFlickerEffect effect(backlight, FRAMES);
+    auto t1 = std::chrono::steady_clock::now();
+
+    std::vector<float> lit;
+    std::vector<unsigned> dark;
+    float worst = 0.0f;
+    unsigned worst_frame = 0;
+    for (unsigned i = 0; i < LOOPS * FRAMES; i++) {
+        effect.update();
+        float error = std::fabs(effect.brightness() - reference[i % FRAMES]);
+        if (error > worst) {
+            worst = error;
+            worst_frame = i % FRAMES;
+        }
+        lit.push_back(effect.brightness());
+        dark.push_back(effect.dark_refreshes());
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    printf("phasors vs sines: worst error %.2g at frame %u\n",
+           worst, worst_frame);
+    assert(worst < TOLERANCE);
+
+    // The last loop has nothing after it to check against.
+    for (unsigned i = 0; i < (LOOPS - 1) * FRAMES; i++) {
+        unsigned run = 0;
+        while (lit[i + run] <= 0.0f) {
+            run++;
+        }
+        assert(dark[i] == run);
+    }
+
+    for (unsigned f = 0; f < FRAMES; f += 97) {
+        float error = std::fabs(effect.frame_brightness(f) - reference[f]);
+        assert(error < TOLERANCE);
+    }
+
+    std::chrono::duration<double, std::micro> setup = t1 - t0;
+    std::chrono::duration<double, std::micro> run = t2 - t1;
+    printf("setup %.0f uSec, update %.3f uSec\n",
+           setup.count(), run.count() / (LOOPS * FRAMES));
+    printf("OK\n");
+    return 0;
+}
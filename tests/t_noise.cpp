@@ -0,0 +1,184 @@
+// Host test and benchmark of the static noise generator and bank.
+//
+//   g++ -std=c++20 -O2 -I../main/include t_noise.cpp ../main/noise.cpp
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "../main/include/noise.h"
+
+static const size_t N = 240 * 240;
+static const int REPS = 200;
+
+// As configured in main.cpp, spi_display.h and static_injector.h.
+static const size_t WIDTH = 240;
+static const size_t BANK_BYTES = 32 * 1024;
+static const size_t STRIPE_HEIGHT = 8;
+static const size_t MAX_STATIC = 1200;
+
+alignas(16) static uint16_t a[N], b[N];
+
+static uint16_t swap(uint16_t c)
+{
+    return c << 8 | c >> 8;
+}
+
+// The loop send_static_stripe() used to run.
+static void rand_loop(void *dest, size_t count)
+{
+    typedef PackedColorEE<EOrder::RGB565, PixelEndian::BIG> pixel;
+    auto *pixels = (pixel *)dest;
+    for (size_t i = 0; i < count; i += 4) {
+        int x = std::rand();
+        pixels[i + 0] = pixel::from_grey8(x >> 0 & 0xFF);
+        pixels[i + 1] = pixel::from_grey8(x >> 8 & 0xFF);
+        pixels[i + 2] = pixel::from_grey8(x >> 16 & 0xFF);
+        pixels[i + 3] = pixel::from_grey8(x >> 23 & 0xFF);
+    }
+}
+
+static uint64_t hash_row(const uint16_t *row)
+{
+    uint64_t h = 0xCBF29CE484222325;
+    for (size_t i = 0; i < WIDTH; i++) {
+        h = (h ^ row[i]) * 0x100000001B3;
+    }
+    return h;
+}
+
+// A longest burst of static from the bank shouldn't repeat itself.
+// Look for any row that matches a row a fixed distance later.  If
+// the bank had a period, some distance would match again and again.
+static void test_bank_repetition()
+{
+    const size_t ROWS = MAX_STATIC * STRIPE_HEIGHT;
+    alignas(16) static uint16_t bank[BANK_BYTES / 2];
+    static uint16_t burst[ROWS][WIDTH];
+
+    NoiseBank nb(bank, sizeof bank, WIDTH, PixelEndian::BIG, 12345);
+    for (size_t s = 0; s < MAX_STATIC; s++) {
+        nb.fill_565(burst[s * STRIPE_HEIGHT], STRIPE_HEIGHT);
+    }
+
+    // Still uniform grey.
+    size_t histogram[64] = {};
+    for (size_t r = 0; r < ROWS; r++) {
+        for (size_t i = 0; i < WIDTH; i++) {
+            uint16_t c = swap(burst[r][i]);
+            unsigned red = c >> 11, g = c >> 5 & 0x3F, blue = c & 0x1F;
+            assert(red == blue && red == g >> 1);
+            histogram[g]++;
+        }
+    }
+    for (size_t g = 0; g < 64; g++) {
+        assert(histogram[g] > ROWS * WIDTH / 64 * 9 / 10);
+        assert(histogram[g] < ROWS * WIDTH / 64 * 11 / 10);
+    }
+
+    std::vector<uint64_t> hashes(ROWS);
+    for (size_t r = 0; r < ROWS; r++) {
+        hashes[r] = hash_row(burst[r]);
+    }
+    size_t repeats = 0, worst_lag = 0, worst_count = 0;
+    for (size_t lag = 1; lag < ROWS; lag++) {
+        size_t count = 0;
+        for (size_t r = 0; r + lag < ROWS; r++) {
+            if (hashes[r] == hashes[r + lag] &&
+                !std::memcmp(burst[r], burst[r + lag], sizeof burst[r])) {
+                count++;
+            }
+        }
+        repeats += count;
+        if (count > worst_count) {
+            worst_count = count;
+            worst_lag = lag;
+        }
+    }
+    // No whole stripe repeats, either.
+    size_t stripe_repeats = 0;
+    for (size_t a = 0; a < ROWS; a += STRIPE_HEIGHT) {
+        for (size_t b = a + STRIPE_HEIGHT; b < ROWS; b += STRIPE_HEIGHT) {
+            if (!std::memcmp(burst[a], burst[b],
+                             sizeof burst[0] * STRIPE_HEIGHT)) {
+                stripe_repeats++;
+            }
+        }
+    }
+    printf("bank: %zu rows, %zu row pairs repeat in %zu rows, "
+           "at most %zu at lag %zu, %zu stripes repeat\n",
+           nb.row_count(), repeats, ROWS,
+           worst_count, worst_lag, stripe_repeats);
+
+    // About 9600^2 / 2 / 520,000 = 90 repeated pairs, scattered.
+    assert(repeats < 200);
+    assert(worst_count <= 3);
+    assert(stripe_repeats == 0);
+}
+
+template <class F>
+static double usec_per_frame(F fill)
+{
+    auto before = std::chrono::steady_clock::now();
+    for (int rep = 0; rep < REPS; rep++) {
+        fill();
+    }
+    std::chrono::duration<double, std::micro> dt =
+        std::chrono::steady_clock::now() - before;
+    return dt.count() / REPS;
+}
+
+int main()
+{
+    // Every pixel is grey, and every grey turns up about equally.
+    NoiseGenerator gen(1);
+    gen.fill_565_reference(a, N, PixelEndian::LITTLE);
+    size_t histogram[64] = {};
+    for (size_t i = 0; i < N; i++) {
+        unsigned r = a[i] >> 11, g = a[i] >> 5 & 0x3F, b = a[i] & 0x1F;
+        assert(r == b && r == g >> 1);
+        histogram[g]++;
+    }
+    for (size_t g = 0; g < 64; g++) {
+        assert(histogram[g] > N / 64 * 9 / 10);
+        assert(histogram[g] < N / 64 * 11 / 10);
+    }
+
+    // Big endian is the same noise, byte swapped.
+    NoiseGenerator le(7), be(7);
+    le.fill_565_reference(a, N, PixelEndian::LITTLE);
+    be.fill_565_reference(b, N, PixelEndian::BIG);
+    for (size_t i = 0; i < N; i++) {
+        assert(b[i] == swap(a[i]));
+    }
+
+    // Off target, fill_565 falls back to the reference.
+    NoiseGenerator ref(3), fast(3);
+    for (int rep = 0; rep < 3; rep++) {
+        ref.fill_565_reference(a, N, PixelEndian::BIG);
+        fast.fill_565(b, N, PixelEndian::BIG);
+        assert(!std::memcmp(a, b, sizeof a));
+    }
+
+    test_bank_repetition();
+
+    double loop = usec_per_frame([] { rand_loop(a, N); });
+    double noise = usec_per_frame([&] {
+        gen.fill_565(b, N, PixelEndian::BIG);
+    });
+    printf("rand loop  %8.1f uSec/frame\n", loop);
+    printf("noise      %8.1f uSec/frame  (%.1fx)\n", noise, loop / noise);
+
+    alignas(16) static uint16_t bank[BANK_BYTES / 2];
+    NoiseBank nb(bank, sizeof bank, WIDTH, PixelEndian::BIG, 1);
+    double banked = usec_per_frame([&] {
+        nb.fill_565(b, N / WIDTH);
+    });
+    printf("bank       %8.1f uSec/frame  (%.1fx)\n", banked, loop / banked);
+
+    printf("OK\n");
+    return 0;
+}
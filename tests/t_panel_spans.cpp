@@ -0,0 +1,132 @@
+// Host check of round panel clipping: no pixel the panel shows is
+// dropped, and how many SPI bytes a frame saves.
+//
+//   g++ -std=c++20 -O2 -I../main/include t_panel_spans.cpp ../main/panel_spans.cpp
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "../main/include/panel_spans.h"
+
+static const size_t W = 240;
+static const size_t H = 240;
+static const size_t PIXEL_SIZE = 2;
+
+// Does any part of pixel (x, y) fall inside the circle inscribed in
+// a panel_w by panel_h panel?  Independent of PanelSpans' integer
+// arithmetic: find the nearest point of the pixel to the center.
+static bool visible(size_t x, size_t y, size_t panel_w, size_t panel_h)
+{
+    double cx = panel_w / 2.0, cy = panel_h / 2.0;
+    double r = std::min(panel_w, panel_h) / 2.0;
+    double nx = std::clamp(cx, (double)x, x + 1.0);
+    double ny = std::clamp(cy, (double)y, y + 1.0);
+    return (nx - cx) * (nx - cx) + (ny - cy) * (ny - cy) < r * r;
+}
+
+static int check_coverage(size_t panel_w, size_t panel_h, bool round)
+{
+    PanelSpans spans(panel_w, panel_h, round, W, H);
+    size_t xo = (panel_w - W) / 2, yo = (panel_h - H) / 2;
+    int errors = 0;
+    for (size_t y = 0; y < H; y++) {
+        auto row = spans.row(y);
+        for (size_t x = 0; x < W; x++) {
+            bool shown = !round || visible(x + xo, y + yo, panel_w, panel_h);
+            bool sent = row.x0 <= x && x < row.x1;
+            if (shown && !sent) {
+                printf("%zux%zu: pixel (%zu, %zu) dropped\n",
+                       panel_w, panel_h, x, y);
+                errors++;
+            }
+            // Spans are tight: their end pixels are shown.
+            if (sent && (x == row.x0 || x + 1 == row.x1) && !shown) {
+                printf("%zux%zu: row %zu span [%u, %u) is loose\n",
+                       panel_w, panel_h, y, row.x0, row.x1);
+                errors++;
+            }
+        }
+    }
+    for (size_t h : {4, 8, 16}) {
+        for (size_t y = 0; y < H; y += h) {
+            auto s = spans.stripe(y, h);
+            for (size_t row = y; row < y + h; row++) {
+                auto r = spans.row(row);
+                if (r.x0 < s.x0 || r.x1 > s.x1) {
+                    printf("stripe %zu+%zu doesn't cover row %zu\n", y, h, row);
+                    errors++;
+                }
+            }
+        }
+    }
+    return errors;
+}
+
+// Gather every stripe, in place and out of place, and compare
+// against the source.
+static int check_gather(size_t h)
+{
+    PanelSpans spans(W, H, true, W, H);
+    std::vector<uint16_t> image(W * H), dest(W * h), copy(W * h);
+    for (size_t i = 0; i < image.size(); i++) {
+        image[i] = (uint16_t)(i * 2654435761u >> 16);
+    }
+    int errors = 0;
+    for (size_t y = 0; y < H; y += h) {
+        const uint16_t *src = &image[y * W];
+        auto s = spans.gather(dest.data(), src, y, h, PIXEL_SIZE);
+        std::memcpy(copy.data(), src, W * h * PIXEL_SIZE);
+        spans.gather(copy.data(), copy.data(), y, h, PIXEL_SIZE);
+        for (size_t row = 0; row < h; row++) {
+            for (size_t x = s.x0; x < s.x1; x++) {
+                uint16_t want = src[row * W + x];
+                size_t i = row * s.width() + x - s.x0;
+                if (dest[i] != want || copy[i] != want) {
+                    errors++;
+                }
+            }
+        }
+    }
+    if (errors) {
+        printf("gather, stripe height %zu: %d pixels wrong\n", h, errors);
+    }
+    return errors;
+}
+
+int main()
+{
+    int errors = 0;
+    errors += check_coverage(240, 240, true);       // GC9A01
+    errors += check_coverage(240, 280, false);      // ST7789
+    errors += check_coverage(240, 280, true);       // taller round
+    for (size_t h : {4, 8, 16}) {
+        errors += check_gather(h);
+    }
+
+    const size_t FRAME_BYTES = W * H * PIXEL_SIZE;
+    PanelSpans spans(240, 240, true, W, H);
+    size_t exact = 0;
+    for (size_t y = 0; y < H; y++) {
+        exact += spans.row(y).width() * PIXEL_SIZE;
+    }
+    printf("SPI bytes per frame, 240x240 round panel\n");
+    printf("  %-12s %7zu\n", "rectangle", FRAME_BYTES);
+    printf("  %-12s %7zu  saves %5.1f%%\n", "rows", exact,
+           100.0 * (FRAME_BYTES - exact) / FRAME_BYTES);
+    for (size_t h : {4, 8, 16, 24}) {
+        size_t bytes = 0;
+        for (size_t y = 0; y < H; y += h) {
+            bytes += spans.stripe(y, h).width() * h * PIXEL_SIZE;
+        }
+        printf("  stripes of %-2zu %6zu  saves %5.1f%% (%zu bytes)\n",
+               h, bytes, 100.0 * (FRAME_BYTES - bytes) / FRAME_BYTES,
+               FRAME_BYTES - bytes);
+    }
+
+    printf(errors ? "FAIL\n" : "OK\n");
+    return errors != 0;
+}
@@ -0,0 +1,111 @@
+// Host test of the random streams, and a benchmark against the
+// std::rand() wrapper they replaced.
+//
+//   g++ -std=c++20 -O2 -I../main/include t_random.cpp
+
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "../main/include/random.h"
+
+static const int N = 10'000'000;
+
+// The old Random: newlib's std::rand() and a biased modulo.
+struct OldRandom {
+    unsigned rand() { return std::rand(); }
+    unsigned randint(unsigned min, unsigned max)
+    {
+        return min + rand() % (max - min);
+    }
+};
+
+template <class F>
+static double nsec_per_call(F f)
+{
+    volatile uint32_t sink = 0;
+    auto before = std::chrono::steady_clock::now();
+    for (int i = 0; i < N; i++) {
+        sink = sink + f();
+    }
+    std::chrono::duration<double, std::nano> dt =
+        std::chrono::steady_clock::now() - before;
+    return dt.count() / N;
+}
+
+template <class R>
+static void benchmark(const char *name, R& r)
+{
+    double raw = nsec_per_call([&] { return r.rand(); });
+    double ranged = nsec_per_call([&] { return r.randint(150, 4000); });
+    printf("%-10s  rand %5.2f nSec  randint %5.2f nSec\n",
+           name, raw, ranged);
+}
+
+int main()
+{
+    // PCG's reference: pcg32_srandom(42, 54).
+    Random pcg(42, 54);
+    const uint32_t expected[] = {
+        0xa15c02b7, 0x7b47f409, 0xba1d3330,
+        0x83d2f293, 0xbfa4784b, 0xcbed606e,
+    };
+    for (uint32_t e : expected) {
+        assert(pcg.rand() == e);
+    }
+
+    // Same seed and stream replay; different streams don't.
+    {
+        Random a(7, RANDOM_STREAM_STATIC), b(7, RANDOM_STREAM_STATIC);
+        Random c(7, RANDOM_STREAM_ANIMATION);
+        FastRandom fa(7, RANDOM_STREAM_STATIC), fb(7, RANDOM_STREAM_STATIC);
+        FastRandom fc(7, RANDOM_STREAM_ANIMATION);
+        int same = 0, fsame = 0;
+        for (int i = 0; i < 1000; i++) {
+            uint32_t x = a.rand(), fx = fa.rand();
+            assert(x == b.rand());
+            assert(fx == fb.rand());
+            same += x == c.rand();
+            fsame += fx == fc.rand();
+        }
+        assert(same == 0 && fsame == 0);
+    }
+
+    // randint stays in range and isn't biased.  With a range of
+    // 3 * 2^30, a modulo would land in the bottom third half the
+    // time.
+    {
+        Random r(1, 1);
+        for (int i = 0; i < 100'000; i++) {
+            int x = r.randint(20, 1200);
+            assert(20 <= x && x < 1200);
+        }
+        const uint32_t RANGE = 3u << 30;
+        const int TRIALS = 300'000;
+        int low = 0;
+        for (int i = 0; i < TRIALS; i++) {
+            low += r.randint(0u, RANGE) < RANGE / 3;
+        }
+        double f = (double)low / TRIALS;
+        assert(f > 0.33 && f < 0.337);
+
+        float lo = 1, hi = 0;
+        for (int i = 0; i < 100'000; i++) {
+            float u = r.uniform();
+            lo = u < lo ? u : lo;
+            hi = u > hi ? u : hi;
+        }
+        assert(0 <= lo && lo < 0.001f && 0.999f < hi && hi < 1);
+    }
+
+    OldRandom old;
+    Random pcg32(1, RANDOM_STREAM_STATIC);
+    FastRandom xorshift(1, RANDOM_STREAM_STATIC);
+    benchmark("std::rand", old);
+    benchmark("Pcg32", pcg32);
+    benchmark("Xorshift32", xorshift);
+
+    printf("OK\n");
+    return 0;
+}
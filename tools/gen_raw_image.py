@@ -2,6 +2,7 @@
 
 import argparse
 import re
+import struct
 import sys
 
 EXPECTED_HEIGHT = 240
@@ -56,31 +57,146 @@ def reformat(frames, format):
     return reformatted_frames
 
 
-def gen_binary(frames, little_endian, pad_size):
-
-    def frame_msbs(frame):
-        return [pix >> 8 for pix in frame[1]]
-
-    def frame_lsbs(frame):
-        return [pix & 0xFF for pix in frame[1]]
-
-    def frame_interleaved(frame):
-        msbs = frame_msbs(frame)
-        lsbs = frame_lsbs(frame)
-        # print(f'{frame[0]}: {msbs[:10] =}')
-        # print(f'{frame[0]}: {lsbs[:10] =}')
-        
-        seq = [0] * (len(msbs) + len(lsbs))
-        seq[little_endian::2] = msbs
-        seq[not little_endian::2] = lsbs
-        # print(f'{frame[0]}: {seq[:10] = }')
-        return seq
+def raw_encode_frame(frame, little_endian):
+    fmt = '<H' if little_endian else '>H'
+    return b''.join(struct.pack(fmt, pix) for pix in frame[1])
+
+
+RLE_MAX_PACKET = 128
+RLE_RUN_BIT = 0x80
+
+def rle_encode_frame(frame, little_endian, stripe_height):
+    # Packets never span stripes, so each stripe can be decoded alone.
+    stripe_pixels = stripe_height * EXPECTED_WIDTH
+    pixels = frame[1]
+    return b''.join(rle_encode_pixels(pixels[i:i + stripe_pixels],
+                                      little_endian)
+                    for i in range(0, len(pixels), stripe_pixels))
+
+
+def rle_encode_pixels(pixels, little_endian):
+    # Packet format is documented in main/include/clip_codec.h.
+    fmt = '<H' if little_endian else '>H'
+    out = bytearray()
+    literal = []
+
+    def flush_literal():
+        while literal:
+            chunk = literal[:RLE_MAX_PACKET]
+            del literal[:RLE_MAX_PACKET]
+            out.append(len(chunk) - 1)
+            for pix in chunk:
+                out.extend(struct.pack(fmt, pix))
+
+    i = 0
+    n = len(pixels)
+    while i < n:
+        pix = pixels[i]
+        j = i + 1
+        while j < n and j - i < RLE_MAX_PACKET and pixels[j] == pix:
+            j += 1
+        if j - i >= 2:
+            flush_literal()
+            out.append(RLE_RUN_BIT | (j - i - 1))
+            out += struct.pack(fmt, pix)
+        else:
+            literal.append(pix)
+        i = j
+    flush_literal()
+    return bytes(out)
+
+
+def delta_encode_frames(frames, little_endian, stripe_height, key_interval):
+    # Frame format is documented in main/include/clip_codec.h.
+    assert EXPECTED_HEIGHT % stripe_height == 0
+    stripe_pixels = stripe_height * EXPECTED_WIDTH
+    stripe_count = EXPECTED_HEIGHT // stripe_height
+    assert stripe_count <= 64
+    encoded = []
+    prev = None
+    for (fno, pixels) in frames:
+        stripes = [pixels[i * stripe_pixels:(i + 1) * stripe_pixels]
+                   for i in range(stripe_count)]
+        keyframe = prev is None or fno % key_interval == 0
+        mask = 0
+        data = bytearray()
+        for (i, stripe) in enumerate(stripes):
+            if keyframe or stripe != prev[i]:
+                mask |= 1 << i
+                data += rle_encode_pixels(stripe, little_endian)
+        encoded.append((struct.pack('<Q', mask) + bytes(data), keyframe))
+        prev = stripes
+    return encoded
+
+
+# Clip container.  The format is documented in main/include/clip_codec.h.
+CLIP_MAGIC = b'SCLP'
+CLIP_VERSION = 1
+CLIP_HEADER_FORMAT = '<4sHHHHIBBBBIII'
+CLIP_INDEX_FORMAT = '<III'
+CLIP_FRAME_KEYFRAME = 1 << 0
+CLIP_FRAME_ALIGN = 4
+CLIP_CODECS = {'raw': 0, 'rle': 1, 'delta': 2}
+PIXEL_ORDERS = {'rgb565': 0x5B6550, 'bgr565': 0x50655B}  # enum EOrder
+PIXEL_ENDIAN_BIG = 0b10                                  # enum PixelEndian
+PIXEL_ENDIAN_LITTLE = 0b01
+
+
+def encode_frames(frames, args):
+    """Returns a list of (frame bytes, is keyframe) pairs."""
+    le = args.little_endian
+    if args.codec == 'delta':
+        return delta_encode_frames(frames, le, args.stripe_height,
+                                   args.keyframe_interval)
+    if args.codec == 'rle':
+        return [(rle_encode_frame(f, le, args.stripe_height), True)
+                for f in frames]
+    return [(raw_encode_frame(f, le), True) for f in frames]
+
+
+def gen_clip(frames, args):
+    encoded = encode_frames(frames, args)
+    header_size = struct.calcsize(CLIP_HEADER_FORMAT)
+    index_offset = header_size
+    index_size = len(encoded) * struct.calcsize(CLIP_INDEX_FORMAT)
+    header = struct.pack(
+        CLIP_HEADER_FORMAT,
+        CLIP_MAGIC,
+        CLIP_VERSION,
+        header_size,
+        EXPECTED_WIDTH,
+        EXPECTED_HEIGHT,
+        PIXEL_ORDERS[args.format],
+        PIXEL_ENDIAN_LITTLE if args.little_endian else PIXEL_ENDIAN_BIG,
+        CLIP_CODECS[args.codec],
+        args.stripe_height,
+        0,
+        args.frame_period_us,
+        len(encoded),
+        index_offset,
+    )
 
-    interleaved = sum((frame_interleaved(f) for f in frames), [])
-    # print(f'{interleaved[:10] = }')
-    np = -len(interleaved) % pad_size
-    padding = b'\xff' * np
-    return bytes(interleaved) + padding
+    # Frames start word aligned so raw frames can be memcpy'd quickly.
+    index = bytearray()
+    data = bytearray()
+    offset = index_offset + index_size
+    for (frame, keyframe) in encoded:
+        pad = -offset % CLIP_FRAME_ALIGN
+        data += b'\xff' * pad
+        offset += pad
+        flags = CLIP_FRAME_KEYFRAME if keyframe else 0
+        index += struct.pack(CLIP_INDEX_FORMAT, offset, len(frame), flags)
+        data += frame
+        offset += len(frame)
+    binary = header + bytes(index) + bytes(data)
+    assert len(binary) == offset
+
+    raw_size = sum(2 * len(f[1]) for f in frames)
+    print(f'{len(frames)} frames, {raw_size} raw bytes, '
+          f'{len(binary)} {args.codec} bytes '
+          f'({100 * len(binary) / raw_size:.1f}%)', file=sys.stderr)
+    np = -len(binary) % args.padding
+    return binary + b'\xff' * np
 
 
 def write_binary(file, binary):
@@ -95,12 +211,19 @@ def parse_args(args):
     )
     ap.add_argument('file')
     ap.add_argument('-o', '--output', nargs=1, required=True)
-    ap.add_argument('-p', '--padding', nargs=1, type=int, default=4096)
+    ap.add_argument('-p', '--padding', type=int, default=4096)
     endians = ap.add_mutually_exclusive_group()
     endians.add_argument('-B', '--big-endian', action='store_true')
     endians.add_argument('-l', '--little-endian', action='store_true')
     formats = ['rgb565', 'bgr565']  # add more later
     ap.add_argument('-f', '--format', choices=formats, default='rgb565')
+    codecs = ['raw', 'rle', 'delta']
+    ap.add_argument('-c', '--codec', choices=codecs, default='raw')
+    # --stripe-height must match CONFIG_DISPLAY_STRIPE_HEIGHT.
+    ap.add_argument('--stripe-height', type=int, default=8)
+    ap.add_argument('-k', '--keyframe-interval', type=int, default=16)
+    # The clip's playback rate.  7.5 FPS by default.
+    ap.add_argument('--frame-period-us', type=int, default=133333)
     ns = ap.parse_args(args)
 
     # print(f'{ns = }')
@@ -111,6 +234,5 @@ args = parse_args(sys.argv[1:])
 frames = parse_header(args.file)
 validate(frames)
 frames = reformat(frames, args.format)
-# big endian is the default.  So only look at little_endian.
-binary = gen_binary(frames, args.little_endian, args.padding)
+binary = gen_clip(frames, args)
 write_binary(args.output[0], binary)
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+
+# Convert a trace dump to Chrome trace JSON.
+#
+# The input is a console log or host trace file holding dumps written
+# by Trace::dump() (main/trace.cpp describes the format).  The last
+# dump in the log is converted, or the one --dump picks.  Open the
+# output in chrome://tracing or https://ui.perfetto.dev.
+
+import argparse
+import base64
+import json
+import re
+import struct
+import sys
+
+BEGIN_MARK = '--- trace begin ---'
+END_MARK = '--- trace end ---'
+RECORD = struct.Struct('<IHBBI')
+KINDS = ('begin', 'end', 'instant')
+
+def find_dumps(lines):
+    dumps = []
+    current = None
+    for line in lines:
+        line = line.strip()
+        if line.endswith(BEGIN_MARK):
+            current = []
+        elif line.endswith(END_MARK):
+            if current is not None:
+                dumps.append(current)
+            current = None
+        elif current is not None:
+            current.append(line)
+    return dumps
+
+def parse_dump(lines):
+    ids = {}
+    data = []
+    for line in lines:
+        m = re.match(r'trace id (\d+) (\S+) (\S+)$', line)
+        if m:
+            ids[int(m.group(1))] = (m.group(2), m.group(3))
+        elif line.startswith('trace:'):
+            print(line, file=sys.stderr)
+        elif line:
+            data.append(line)
+    raw = base64.b64decode(''.join(data))
+    assert len(raw) % RECORD.size == 0, 'truncated dump'
+    return ids, list(RECORD.iter_unpack(raw))
+
+def to_chrome(ids, records):
+    events = []
+    open_spans = set()
+    base = None
+    last = 0
+    wraps = 0
+    for (usec, tid, kind, core, arg) in records:
+        # Timestamps are the low 32 bits; they wrap every 71 minutes.
+        if base is not None and usec < last and last - usec > 1 << 31:
+            wraps += 1
+        last = usec
+        usec += wraps << 32
+        if base is None:
+            base = usec
+        name, style = ids.get(tid, (f'id{tid}', 'instant'))
+        event = {
+            'name': name,
+            'ts': usec - base,
+            'pid': 0,
+            'tid': core,
+            'args': {'arg': arg},
+        }
+        if KINDS[kind] == 'instant':
+            event.update(ph='i', s='t')
+        else:
+            # Drop ends whose begins were overwritten in the ring.
+            # Async spans can end on another core.
+            is_async = style == 'async'
+            key = (tid, None if is_async else core)
+            if KINDS[kind] == 'begin':
+                open_spans.add(key)
+                event['ph'] = 'b' if is_async else 'B'
+            elif key in open_spans:
+                open_spans.discard(key)
+                event['ph'] = 'e' if is_async else 'E'
+            else:
+                continue
+            if is_async:
+                event.update(cat=name, id=tid)
+        events.append(event)
+    for core in sorted({e['tid'] for e in events}):
+        events.append({'name': 'thread_name', 'ph': 'M', 'pid': 0,
+                       'tid': core, 'args': {'name': f'core {core}'}})
+    return {'traceEvents': events, 'displayTimeUnit': 'ms'}
+
+def parse_args(args):
+    ap = argparse.ArgumentParser(
+        prog='trace_to_json',
+        description='Convert a trace dump to Chrome trace JSON',
+    )
+    ap.add_argument('file', help='console log or trace file; - for stdin')
+    ap.add_argument('-o', '--output', help='JSON file; stdout by default')
+    ap.add_argument('-d', '--dump', type=int, default=-1,
+                    help='which dump to convert, 0 first, -1 last')
+    return ap.parse_args(args)
+
+args = parse_args(sys.argv[1:])
+if args.file == '-':
+    lines = sys.stdin.read().splitlines()
+else:
+    with open(args.file, errors='replace') as f:
+        lines = f.read().splitlines()
+dumps = find_dumps(lines)
+if not dumps:
+    sys.exit(f'{args.file}: no trace dump found')
+ids, records = parse_dump(dumps[args.dump])
+trace = to_chrome(ids, records)
+if args.output:
+    with open(args.output, 'w') as out:
+        json.dump(trace, out)
+else:
+    json.dump(trace, sys.stdout)